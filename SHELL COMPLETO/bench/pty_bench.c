@@ -0,0 +1,356 @@
+/**
+ * Linux Job Control Shell Project
+ * Job control benchmark
+ *
+ * Runs the shell on a pseudo-terminal, as a user would, and times:
+ *   spawn    /bin/true run in the foreground, with fork, vfork and the zygote pool:
+ *            throughput with the commands queued, then p50/p99 latency of
+ *            one command at a time (from the line sent to the next prompt)
+ *   bgteam   "bgteam N /bin/true" until the reaper has reported all N jobs
+ *   chatty   "bgteam -j 8 C" jobs printing 5000 lines each, to the terminal
+ *            and with "set capture on", until all C are reported
+ *   jobs     the jobs builtin with M background jobs in the table
+ *   fg       "fg N" on a stopped cat with M other jobs in the table,
+ *            until cat has read EOF and the shell reports it
+ * Prints one CSV row per measure: benchmark,param,value,unit
+ *
+ * To compile and run (make bench does both):
+ *   $ gcc -O2 bench/pty_bench.c -o pty_bench -lutil
+ *   $ ./pty_bench [-s spawns] [-t team sizes] [-c chatty jobs] [-j table sizes] ./shell
+ * Sizes are comma separated lists, e.g. -t 10,100,1000
+ **/
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <pty.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define PROMPT "COMMAND->"
+
+static int master = -1;
+static pid_t shell_pid;
+
+/* Output matcher: counts the occurrences of pattern seen since it was set */
+static const char * pattern;
+static size_t matched;   /* Bytes of pattern matched at the end of the output so far */
+static long found;
+
+static long long now_ns(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+static void expect(const char * p)
+{
+	pattern = p;
+	matched = 0;
+	found = 0;
+}
+
+static void scan(const char * buf, ssize_t n)
+{
+	size_t len = strlen(pattern);
+	for (ssize_t i = 0; i < n; i++)
+	{
+		/* Patterns have no repeated prefix, so a mismatch restarts the match */
+		if (buf[i] == pattern[matched]) matched++;
+		else matched = (buf[i] == pattern[0]);
+		if (matched == len)
+		{
+			found++;
+			matched = 0;
+		}
+	}
+}
+
+/**
+ * Writes input to the shell while reading its output, until all input is
+ * written and pattern has been seen count times
+ **/
+static int drive(const char * input, long count)
+{
+	size_t left = input ? strlen(input) : 0;
+	char buf[65536];
+	while (left > 0 || found < count)
+	{
+		struct pollfd p = { .fd = master, .events = POLLIN | (left > 0 ? POLLOUT : 0) };
+		if (poll(&p, 1, 30000) <= 0)
+		{
+			fprintf(stderr, "pty_bench: timeout waiting for \"%s\" (%ld of %ld)\n", pattern, found, count);
+			return -1;
+		}
+		if (p.revents & POLLIN)
+		{
+			ssize_t n = read(master, buf, sizeof(buf));
+			if (n <= 0)
+			{
+				fprintf(stderr, "pty_bench: the shell exited\n");
+				return -1;
+			}
+			scan(buf, n);
+		}
+		if ((p.revents & POLLOUT) && left > 0)
+		{
+			ssize_t w = write(master, input, left);
+			if (w > 0)
+			{
+				input += w;
+				left -= w;
+			}
+		}
+	}
+	return 0;
+}
+
+/* Sends a command and waits for the next prompt */
+static int command(const char * line)
+{
+	expect(PROMPT);
+	return drive(line, 1);
+}
+
+/* Kills every job process of the shell and waits until the reaper reports them */
+static int kill_children(void)
+{
+	DIR * d = opendir("/proc");
+	struct dirent * e;
+	char path[64];
+	long killed = 0;
+	expect("Signaled");
+	while (d && (e = readdir(d)) != NULL)
+	{
+		int pid = atoi(e->d_name), ppid;
+		char state;
+		if (pid <= 0) continue;
+		snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+		FILE * f = fopen(path, "r");
+		if (!f) continue;
+		/* Jobs only: the zygote helper and its ready children stay in the shell's group */
+		if (fscanf(f, "%*d (%*[^)]) %c %d", &state, &ppid) == 2 && ppid == shell_pid && state != 'Z' &&
+		    getpgid(pid) != shell_pid)
+		{
+			kill(pid, SIGKILL);
+			killed++;
+		}
+		fclose(f);
+	}
+	if (d) closedir(d);
+	return drive(NULL, killed);
+}
+
+/* line repeated n times, in one string */
+static char * repeat(const char * line, long n)
+{
+	size_t len = strlen(line);
+	char * s = malloc(len * n + 1);
+	for (long i = 0; i < n; i++) memcpy(s + i * len, line, len);
+	s[len * n] = '\0';
+	return s;
+}
+
+static int cmp_ll(const void * a, const void * b)
+{
+	long long x = *(const long long *) a, y = *(const long long *) b;
+	return x < y ? -1 : x > y;
+}
+
+static void report(const char * name, long param, double value, const char * unit)
+{
+	printf("%s,%ld,%.3f,%s\n", name, param, value, unit);
+	fflush(stdout);
+}
+
+static int bench_spawn(const char * mode, long n)
+{
+	char line[64], name[32];
+	snprintf(line, sizeof(line), "set spawn %s\n", mode);
+	if (command(line) == -1) return -1;
+
+	char * input = repeat("/bin/true\n", n);
+	expect(PROMPT);
+	long long t0 = now_ns();
+	int r = drive(input, n);
+	long long t1 = now_ns();
+	free(input);
+	snprintf(name, sizeof(name), "spawn_%s", mode);
+	if (r == 0) report(name, n, n / ((t1 - t0) / 1e9), "spawns_per_sec");
+
+	/* Latency: the next command is sent only after the previous prompt */
+	long long * lat = malloc(n * sizeof(long long));
+	for (long i = 0; i < n && r == 0; i++)
+	{
+		expect(PROMPT);
+		t0 = now_ns();
+		r = drive("/bin/true\n", 1);
+		lat[i] = now_ns() - t0;
+	}
+	if (r == 0)
+	{
+		qsort(lat, n, sizeof(long long), cmp_ll);
+		snprintf(name, sizeof(name), "spawn_%s_p50", mode);
+		report(name, n, lat[n / 2] / 1e3, "us");
+		snprintf(name, sizeof(name), "spawn_%s_p99", mode);
+		report(name, n, lat[n * 99 / 100] / 1e3, "us");
+	}
+	free(lat);
+	return r;
+}
+
+static int bench_team(long n)
+{
+	char line[64];
+	snprintf(line, sizeof(line), "bgteam %ld /bin/true\n", n);
+	expect("Exited");
+	long long t0 = now_ns();
+	int r = drive(line, n);
+	long long t1 = now_ns();
+	if (r == 0)
+	{
+		report("bgteam_total", n, (t1 - t0) / 1e6, "ms");
+		report("bgteam_per_job", n, (t1 - t0) / 1e3 / n, "us");
+	}
+	return r == 0 ? command("\n") : r;
+}
+
+static int bench_chatty(const char * capture, long n)
+{
+	char line[96], name[32];
+	snprintf(line, sizeof(line), "set capture %s\n", capture);
+	if (command(line) == -1) return -1;
+
+	snprintf(line, sizeof(line), "bgteam -j 8 %ld sh -c 'seq 1 5000'\n", n);
+	expect("Exited");
+	long long t0 = now_ns();
+	int r = drive(line, n);
+	long long t1 = now_ns();
+	snprintf(name, sizeof(name), "chatty_capture_%s", capture);
+	if (r == 0) report(name, n, (t1 - t0) / 1e6, "ms");
+	return r == 0 ? command("\n") : r;
+}
+
+static int bench_table(long m)
+{
+	/* m background jobs, then a cat that stops on SIGTTIN as job m+1 */
+	char * input = repeat("sleep 100000 &\n", m);
+	expect(PROMPT);
+	int r = drive(input, m);
+	free(input);
+	if (r == -1) return -1;
+	expect("Suspended");
+	if (drive("cat &\n", 1) == -1) return -1;
+
+	const int reps = 20;
+	expect(PROMPT);
+	long long t0 = now_ns();
+	for (int i = 0; i < reps && r == 0; i++)
+	{
+		long before = found;
+		r = drive("jobs\n", before + 1);
+	}
+	long long t1 = now_ns();
+	if (r == -1) return -1;
+	report("jobs", m, (t1 - t0) / 1e3 / reps, "us");
+
+	/* EOF right behind the command: the shell reads one line, cat gets the ^D */
+	char line[64];
+	snprintf(line, sizeof(line), "fg %ld\n\004", m + 1);
+	expect("command: cat, Exited");
+	t0 = now_ns();
+	r = drive(line, 1);
+	t1 = now_ns();
+	if (r == -1) return -1;
+	report("fg", m, (t1 - t0) / 1e3, "us");
+
+	return kill_children() == -1 ? -1 : command("\n");
+}
+
+static long * parse_list(const char * s, int * n)
+{
+	long * v = malloc(sizeof(long) * (strlen(s) / 2 + 2));
+	*n = 0;
+	for (char * end; *s; s = *end ? end + 1 : end)
+	{
+		v[(*n)++] = strtol(s, &end, 10);
+		if (end == s) break;
+	}
+	return v;
+}
+
+int main(int argc, char ** argv)
+{
+	long spawns = 2000;
+	const char * team = "10,100,1000,10000";
+	const char * table = "10,100,1000";
+	long chatty = 100;
+	int opt;
+	while ((opt = getopt(argc, argv, "s:t:c:j:")) != -1)
+	{
+		if (opt == 's') spawns = atol(optarg);
+		else if (opt == 't') team = optarg;
+		else if (opt == 'c') chatty = atol(optarg);
+		else if (opt == 'j') table = optarg;
+		else return 2;
+	}
+	if (optind >= argc)
+	{
+		fprintf(stderr, "Usage: %s [-s spawns] [-t team sizes] [-c chatty jobs] [-j table sizes] shell\n", argv[0]);
+		return 2;
+	}
+
+	struct termios tio;
+	cfmakeraw(&tio);
+	tio.c_lflag |= ICANON | ISIG;  /* Line input and ^Z/^C as on a terminal, no echo */
+	tio.c_oflag |= OPOST | ONLCR;
+	tio.c_cc[VEOF] = 4;
+	tio.c_cc[VSUSP] = 26;
+	tio.c_cc[VINTR] = 3;
+	tio.c_cc[VMIN] = 1;
+	shell_pid = forkpty(&master, NULL, &tio, NULL);
+	if (shell_pid == -1)
+	{
+		perror("forkpty");
+		return 1;
+	}
+	if (shell_pid == 0)
+	{
+		execl(argv[optind], argv[optind], (char *) NULL);
+		_exit(127);
+	}
+	signal(SIGPIPE, SIG_IGN);
+
+	int n, r = 0;
+	expect(PROMPT);
+	if (drive(NULL, 1) == -1) r = -1;
+
+	printf("benchmark,param,value,unit\n");
+	if (r == 0) r = bench_spawn("fork", spawns);
+	if (r == 0) r = bench_spawn("vfork", spawns);
+	if (r == 0) r = bench_spawn("zygote", spawns);
+	if (r == 0) r = command("set spawn fork\n");
+
+	long * sizes = parse_list(team, &n);
+	for (int i = 0; i < n && r == 0; i++) r = bench_team(sizes[i]);
+	free(sizes);
+
+	if (r == 0 && chatty > 0) r = bench_chatty("off", chatty);
+	if (r == 0 && chatty > 0) r = bench_chatty("on", chatty);
+	if (r == 0) r = command("set capture off\n");
+
+	sizes = parse_list(table, &n);
+	for (int i = 0; i < n && r == 0; i++) r = bench_table(sizes[i]);
+	free(sizes);
+
+	kill(shell_pid, SIGKILL);
+	waitpid(shell_pid, NULL, 0);
+	return r == 0 ? 0 : 1;
+}
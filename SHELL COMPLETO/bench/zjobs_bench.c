@@ -0,0 +1,95 @@
+/**
+ * Linux Job Control Shell Project
+ * zjobs microbenchmark
+ *
+ * Leaves a number of zombie children and then times the original zjobs
+ * loop (readdir + fopen/fscanf per /proc entry) against the proc_scan
+ * functions. Prints one CSV row per scanner:
+ * scanner,zombies,found,us_per_scan
+ * The children row is skipped on kernels without /proc/<pid>/task/<tid>/children.
+ *
+ * To compile and run:
+ *   $ gcc -O2 bench/zjobs_bench.c proc_scan.c -o zjobs_bench
+ *   $ ./zjobs_bench [zombies] [iterations]
+ **/
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "../proc_scan.h"
+
+#define MAX_ZOMBIES 65536
+
+static pid_t pids[MAX_ZOMBIES];
+
+static long long now_ns(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+/* The shell's zjobs before proc_scan, counting instead of printing */
+static size_t legacy_traverse(void)
+{
+	DIR *d;
+	struct dirent *dir;
+	char buff[2048];
+	size_t found = 0;
+	d = opendir("/proc");
+	if (d) {
+		while ((dir = readdir(d)) != NULL) {
+			sprintf(buff, "/proc/%s/stat", dir->d_name);
+			FILE *fd = fopen(buff, "r");
+			if (fd){
+				long pid, ppid;
+				char state;
+				fscanf(fd, "%ld %s %c %ld", &pid, buff, &state, &ppid);
+				if (ppid == getpid() && state == 'Z') found++;
+				fclose(fd);
+			}
+		}
+		closedir(d);
+	}
+	return found;
+}
+
+static size_t run_legacy(void)   { return legacy_traverse(); }
+static size_t run_scan(void)     { return scan_zombies(getpid(), pids, MAX_ZOMBIES); }
+static size_t run_children(void) { return children_zombies(pids, MAX_ZOMBIES); }
+
+static void bench(const char * name, size_t (*scanner)(void), int zombies, int iterations)
+{
+	size_t found = scanner();
+	if (found == SCAN_UNAVAILABLE) return;
+	long long t0 = now_ns();
+	for (int i = 0; i < iterations; i++) found = scanner();
+	long long t1 = now_ns();
+	printf("%s,%d,%zu,%.1f\n", name, zombies, found, (double) (t1 - t0) / iterations / 1000);
+}
+
+int main(int argc, char ** argv)
+{
+	int zombies = argc > 1 ? atoi(argv[1]) : 100;
+	int iterations = argc > 2 ? atoi(argv[2]) : 20;
+	if (zombies > MAX_ZOMBIES) zombies = MAX_ZOMBIES;
+
+	for (int i = 0; i < zombies; i++)
+	{
+		pid_t pid = fork();
+		if (pid == 0) _exit(0);
+		if (pid < 0) { zombies = i; break; }
+	}
+	/* Let every child exit and become a zombie */
+	usleep(200000);
+
+	printf("scanner,zombies,found,us_per_scan\n");
+	bench("legacy", run_legacy, zombies, iterations);
+	bench("scan", run_scan, zombies, iterations);
+	bench("children", run_children, zombies, iterations);
+
+	while (wait(NULL) > 0);
+	return 0;
+}
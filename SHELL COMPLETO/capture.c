@@ -0,0 +1,290 @@
+/**
+ * Linux Job Control Shell Project
+ * capture module
+ *
+ * Captures are kept in creation order, so the oldest finished one is the
+ * first given up when the rings need memory. readv() stores data straight
+ * into the ring, in one or two pieces around its end: no copies. A ring
+ * that cannot grow is overwritten from its oldest byte.
+ **/
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "event_loop.h"
+#include "capture.h"
+
+typedef struct capture_
+{
+	int job;                 /* Number the job had */
+	pid_t pgid;              /* Process group of the job, 0 until capture_bind() */
+	char * command;
+	int fd;                  /* Read end of the pipe, -1 after EOF */
+	size_t limit;            /* Ring size wanted (capture size when it was created) */
+	char * ring;
+	size_t cap;              /* Bytes allocated for ring */
+	size_t start, len;       /* Oldest byte stored and number of bytes stored */
+	unsigned long long bytes, dropped;
+	int follow_fd;           /* New output is copied here too (output --follow), -1 if none */
+	struct capture_ * next;  /* Next capture, created later */
+} capture;
+
+capture_counters capture_stats = { .size = 0 };
+
+static capture * captures;
+static char scratch[CAPTURE_CHUNK]; /* Drains a pipe whose ring could not get memory */
+
+static void free_capture(capture * c)
+{
+	capture ** p = &captures;
+	while (*p != c) p = &(*p)->next;
+	*p = c->next;
+	if (c->pgid) capture_stats.kept--;
+	capture_stats.used -= c->cap;
+	free(c->ring);
+	free(c->command);
+	free(c);
+}
+
+/* Frees finished captures, oldest first, until need more bytes fit in CAPTURE_TOTAL
+ * and no more than CAPTURE_KEEP are kept */
+static void evict(size_t need)
+{
+	capture * c = captures;
+	while (c != NULL && (capture_stats.used + need > CAPTURE_TOTAL || capture_stats.kept > CAPTURE_KEEP))
+	{
+		capture * next = c->next;
+		if (c->fd < 0)
+		{
+			free_capture(c);
+			capture_stats.evicted++;
+		}
+		c = next;
+	}
+}
+
+/* Doubles the ring of c, up to its limit and while the total allows it */
+static void grow(capture * c)
+{
+	size_t cap = c->cap ? c->cap * 2 : CAPTURE_CHUNK;
+	if (cap > c->limit) cap = c->limit;
+	if (cap <= c->cap) return;
+	if (capture_stats.used + cap - c->cap > CAPTURE_TOTAL) evict(cap - c->cap);
+	if (capture_stats.used + cap - c->cap > CAPTURE_TOTAL) return;
+	char * ring = malloc(cap);
+	if (ring == NULL) return;
+	size_t first = c->cap - c->start < c->len ? c->cap - c->start : c->len;
+	if (c->len)
+	{
+		memcpy(ring, c->ring + c->start, first);
+		memcpy(ring + first, c->ring, c->len - first);
+	}
+	free(c->ring);
+	capture_stats.used += cap - c->cap;
+	c->ring = ring;
+	c->cap = cap;
+	c->start = 0;
+}
+
+static void write_all(int * fd, const char * data, size_t n)
+{
+	while (*fd >= 0 && n > 0)
+	{
+		ssize_t w = write(*fd, data, n);
+		if (w == -1 && errno == EINTR) continue;
+		if (w <= 0)
+		{
+			*fd = -1; /* Stop following, the output is still stored */
+			return;
+		}
+		data += w;
+		n -= w;
+	}
+}
+
+static void close_capture(capture * c)
+{
+	ev_del(c->fd);
+	close(c->fd);
+	c->fd = -1;
+	capture_stats.open--;
+	if (c->pgid == 0) free_capture(c); /* Its job was never started */
+}
+
+static void on_pipe(int fd, uint32_t events, void * data)
+{
+	capture * c = data;
+	size_t batch = 0;
+	while (batch < CAPTURE_BATCH)
+	{
+		if (c->len == c->cap) grow(c);
+		/* Free space after the newest byte; a full ring is overwritten from its oldest byte */
+		struct iovec iov[2] = { { scratch, sizeof(scratch) }, { NULL, 0 } };
+		size_t pos = 0;
+		if (c->cap)
+		{
+			size_t room = c->len < c->cap ? c->cap - c->len : c->cap;
+			pos = (c->start + c->len) % c->cap;
+			iov[0] = (struct iovec) { c->ring + pos, c->cap - pos < room ? c->cap - pos : room };
+			iov[1] = (struct iovec) { c->ring, room - iov[0].iov_len };
+		}
+		ssize_t n = readv(fd, iov, iov[1].iov_len ? 2 : 1);
+		if (n == -1 && errno == EINTR) continue;
+		if (n == -1 && errno == EAGAIN) return;
+		if (n <= 0)
+		{
+			close_capture(c);
+			return;
+		}
+		batch += n;
+		c->bytes += n;
+		capture_stats.bytes += n;
+		capture_stats.reads++;
+		if (c->follow_fd >= 0)
+		{
+			size_t first = (size_t) n < iov[0].iov_len ? (size_t) n : iov[0].iov_len;
+			write_all(&c->follow_fd, iov[0].iov_base, first);
+			write_all(&c->follow_fd, iov[1].iov_base, n - first);
+		}
+		if (c->cap == 0)
+		{
+			c->dropped += n;
+			capture_stats.dropped += n;
+		}
+		else if (c->len + n > c->cap)
+		{
+			c->dropped += c->len + n - c->cap;
+			capture_stats.dropped += c->len + n - c->cap;
+			c->start = (pos + n) % c->cap;
+			c->len = c->cap;
+		}
+		else c->len += n;
+	}
+}
+
+/* Newest capture of process group pgid */
+static capture * find(pid_t pgid)
+{
+	capture * found = NULL;
+	for (capture * c = captures; c; c = c->next)
+		if (pgid > 0 && c->pgid == pgid) found = c;
+	return found;
+}
+
+/**
+ * Creates the pipe for a background job and starts draining it. Returns the
+ * capture and the write end (close-on-exec) in *write_fd, or NULL if capture
+ * is off or the pipe cannot be created
+ **/
+capture * capture_new(int * write_fd)
+{
+	int fds[2];
+	if (capture_stats.size == 0 || pipe2(fds, O_CLOEXEC) == -1) return NULL;
+	capture * c = calloc(1, sizeof(capture));
+	if (c == NULL || fcntl(fds[0], F_SETFL, O_NONBLOCK) == -1 || ev_add(fds[0], EPOLLIN, on_pipe, c) == -1)
+	{
+		free(c);
+		close(fds[0]);
+		close(fds[1]);
+		return NULL;
+	}
+	c->fd = fds[0];
+	c->limit = capture_stats.size;
+	c->follow_fd = -1;
+	capture ** p = &captures;
+	while (*p) p = &(*p)->next;
+	*p = c;
+	capture_stats.open++;
+	*write_fd = fds[1];
+	return c;
+}
+
+/**
+ * Records the job the capture belongs to, once it has been started
+ **/
+void capture_bind(capture * c, int job, pid_t pgid, const char * command)
+{
+	c->job = job;
+	c->pgid = pgid;
+	c->command = strdup(command);
+	capture_stats.kept++;
+	evict(0);
+}
+
+/**
+ * Frees a capture whose job could not be started
+ **/
+void capture_cancel(capture * c)
+{
+	close_capture(c);
+}
+
+/**
+ * Returns the pgid of the newest capture of job number job, 0 if none
+ **/
+pid_t capture_lookup(int job)
+{
+	pid_t pgid = 0;
+	for (capture * c = captures; c; c = c->next)
+		if (c->pgid && c->job == job) pgid = c->pgid;
+	return pgid;
+}
+
+/**
+ * Returns 1 if the pipe of pgid is still open, 0 if it reached EOF, -1 if
+ * pgid has no capture
+ **/
+int capture_state(pid_t pgid)
+{
+	capture * c = find(pgid);
+	return c == NULL ? -1 : c->fd >= 0;
+}
+
+/**
+ * Writes the stored output of pgid to fd. Returns -1 if it has no capture
+ **/
+int capture_print(pid_t pgid, int fd)
+{
+	capture * c = find(pgid);
+	if (c == NULL) return -1;
+	if (c->dropped) dprintf(fd, "[%llu bytes dropped]\n", c->dropped);
+	int out = fd;
+	size_t first = c->cap - c->start < c->len ? c->cap - c->start : c->len;
+	if (c->len)
+	{
+		write_all(&out, c->ring + c->start, first);
+		write_all(&out, c->ring, c->len - first);
+	}
+	return 0;
+}
+
+/**
+ * Copies the output of pgid to fd as it arrives (-1 to stop). Returns
+ * capture_state(pgid)
+ **/
+int capture_follow(pid_t pgid, int fd)
+{
+	capture * c = find(pgid);
+	if (c == NULL) return -1;
+	c->follow_fd = fd;
+	return c->fd >= 0;
+}
+
+/**
+ * Prints the counters and the captures that can be read back
+ **/
+void capture_list(void)
+{
+	printf("capture %s, ring %zu, memory %zu/%d, open %d, kept %d, bytes %llu, dropped %llu, reads %llu, evicted %lu\n",
+	       capture_stats.size ? "on" : "off", capture_stats.size, capture_stats.used, CAPTURE_TOTAL,
+	       capture_stats.open, capture_stats.kept, capture_stats.bytes, capture_stats.dropped,
+	       capture_stats.reads, capture_stats.evicted);
+	for (capture * c = captures; c; c = c->next)
+		if (c->pgid)
+			printf(" [%d] pid: %d, command: %s, %zu bytes, %llu dropped, %s\n", c->job, c->pgid,
+			       c->command ? c->command : "?", c->len, c->dropped, c->fd >= 0 ? "open" : "closed");
+}
@@ -0,0 +1,59 @@
+/**
+ * Linux Job Control Shell Project
+ * Function prototypes for capture module
+ *
+ * "set capture on": the stdout and stderr of background jobs go to a pipe
+ * instead of the terminal. The shell drains every pipe from its epoll loop
+ * into a ring buffer per job, reading at most CAPTURE_BATCH bytes per pipe
+ * and pass, so jobs never wait on a slow terminal and one chatty job does
+ * not starve the others. A ring keeps the last "size" bytes of its job;
+ * older output is counted as dropped. Rings start small and double up to
+ * their size, and all of them together stay under CAPTURE_TOTAL: the
+ * output of finished jobs is given up, oldest first, to make room, and at
+ * most CAPTURE_KEEP captures are kept. The output builtin reads a ring
+ * back, also after the job has ended. Captures are identified by the pgid
+ * of their job, since job numbers are reused as soon as jobs end.
+ * A captured job brought back with fg keeps writing to its pipe, and a job
+ * that outlives the shell gets EPIPE on its next write.
+ **/
+#ifndef _CAPTURE_H
+#define _CAPTURE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define CAPTURE_SIZE   (64 * 1024)   /* Ring size per job by default */
+#define CAPTURE_CHUNK  4096          /* First allocation of a ring */
+#define CAPTURE_TOTAL  (64 << 20)    /* Ring memory of all the captures together */
+#define CAPTURE_BATCH  (256 * 1024)  /* Bytes drained from one pipe per event loop pass */
+#define CAPTURE_KEEP   1024          /* Captures kept, finished ones are freed oldest first */
+
+typedef struct
+{
+	size_t size;                 /* Ring size per job, 0 when capture is off */
+	size_t used;                 /* Ring memory allocated now */
+	int open;                    /* Captures whose pipe still has writers */
+	int kept;                    /* Captures that can be read back (bound to a job) */
+	unsigned long long bytes;    /* Bytes drained from all the pipes */
+	unsigned long long dropped;  /* Bytes overwritten or never stored */
+	unsigned long long reads;    /* read() calls that returned data */
+	unsigned long evicted;       /* Finished captures freed to make room */
+} capture_counters;
+
+extern capture_counters capture_stats;
+
+struct capture_;
+
+/**
+ * Public Functions
+ **/
+struct capture_ * capture_new(int * write_fd);
+void capture_bind(struct capture_ * c, int job, pid_t pgid, const char * command);
+void capture_cancel(struct capture_ * c);
+pid_t capture_lookup(int job);
+int capture_state(pid_t pgid);
+int capture_print(pid_t pgid, int fd);
+int capture_follow(pid_t pgid, int fd);
+void capture_list(void);
+
+#endif
@@ -0,0 +1,208 @@
+/**
+ * Linux Job Control Shell Project
+ * event_log module
+ *
+ * The ring is a multi-producer, single-consumer queue. A producer reserves
+ * a slot with a compare-and-swap on head, fills it and publishes it by
+ * storing its seq last. The writer consumes slots in index order, so the
+ * file keeps the order in which events were reserved. The file is opened
+ * by the writer when the first batch arrives, so nothing is created until
+ * something is logged.
+ **/
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include "job_control.h"
+#include "event_log.h"
+
+#define LOG_BATCH 64
+#define LOG_LINE  160
+
+log_counters log_stats;
+
+static log_record ring[LOG_RECORDS];
+static uint64_t head;             /* Next slot to reserve */
+static uint64_t tail;             /* Next slot to write, owned by the writer */
+static int wake_fd = -1;          /* eventfd the producers poke */
+
+static pthread_mutex_t file_lock = PTHREAD_MUTEX_INITIALIZER;
+static int log_fd = -1;           /* Opened lazily by the writer */
+static int dir_fd = -1;           /* Directory the path was given in: cd does not move the log */
+static char log_path[256];        /* Empty: logging off */
+
+/**
+ * Queues an event. Async-signal-safe: no locks, no allocation
+ **/
+void log_event(enum log_kind kind, pid_t pid, int status, int info, const char * text)
+{
+	if (wake_fd < 0) return;
+	uint64_t i = __atomic_load_n(&head, __ATOMIC_RELAXED);
+	do
+	{
+		if (i - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) >= LOG_RECORDS)
+		{
+			__atomic_fetch_add(&log_stats.dropped, 1, __ATOMIC_RELAXED);
+			return;
+		}
+	} while (!__atomic_compare_exchange_n(&head, &i, i + 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+	log_record * r = &ring[i & (LOG_RECORDS - 1)];
+	struct timespec t;
+	clock_gettime(CLOCK_REALTIME, &t);
+	r->ns = t.tv_sec * 1000000000LL + t.tv_nsec;
+	r->kind = kind;
+	r->pid = pid;
+	r->status = status;
+	r->info = info;
+	size_t n = 0;
+	if (text) while (n < LOG_TEXT - 1 && text[n]) { r->text[n] = text[n]; n++; }
+	r->text[n] = '\0';
+	__atomic_store_n(&r->seq, i + 1, __ATOMIC_RELEASE);
+
+	uint64_t one = 1;
+	int saved_errno = errno;
+	write(wake_fd, &one, sizeof(one));
+	errno = saved_errno;
+}
+
+static int format_record(const log_record * r, char * line)
+{
+	struct tm tm;
+	time_t sec = r->ns / 1000000000LL;
+	localtime_r(&sec, &tm);
+	int n = strftime(line, LOG_LINE, "%Y-%m-%d %H:%M:%S", &tm);
+	n += snprintf(line + n, LOG_LINE - n, ".%03d ", (int) (r->ns / 1000000 % 1000));
+	if (r->kind == LOG_JOB)
+		n += snprintf(line + n, LOG_LINE - n, "pid: %d, command: %s, %s, info: %d\n", r->pid, r->text,
+			r->status >= 0 && r->status <= CONTINUED ? status_strings[r->status] : "?", r->info);
+	else
+		n += snprintf(line + n, LOG_LINE - n, "SIGHUP recibido.\n");
+	return n < LOG_LINE ? n : LOG_LINE - 1;
+}
+
+/**
+ * Writes every published record, LOG_BATCH per writev()
+ **/
+static void drain(void)
+{
+	static char lines[LOG_BATCH][LOG_LINE];
+	struct iovec iov[LOG_BATCH];
+
+	while (1)
+	{
+		uint64_t end = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+		int n = 0;
+		while (tail + n < end && n < LOG_BATCH)
+		{
+			log_record * r = &ring[(tail + n) & (LOG_RECORDS - 1)];
+			if (__atomic_load_n(&r->seq, __ATOMIC_ACQUIRE) != tail + n + 1) break; /* Still being filled */
+			iov[n].iov_base = lines[n];
+			iov[n].iov_len = format_record(r, lines[n]);
+			n++;
+		}
+		if (n == 0)
+		{
+			if (tail == end) return;
+			sched_yield(); /* A producer reserved the next slot and has not published it yet */
+			continue;
+		}
+
+		pthread_mutex_lock(&file_lock);
+		if (log_fd < 0 && log_path[0])
+			log_fd = openat(dir_fd, log_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+		if (log_fd < 0) __atomic_fetch_add(&log_stats.dropped, n, __ATOMIC_RELAXED); /* Producers count their drops too */
+		else
+		{
+			__atomic_fetch_add(&log_stats.batches, 1, __ATOMIC_RELAXED);
+			if (writev(log_fd, iov, n) == -1) __atomic_fetch_add(&log_stats.errors, 1, __ATOMIC_RELAXED);
+			else __atomic_fetch_add(&log_stats.written, n, __ATOMIC_RELAXED);
+		}
+		pthread_mutex_unlock(&file_lock);
+		__atomic_store_n(&tail, tail + n, __ATOMIC_RELEASE);
+	}
+}
+
+static void * log_writer(void * arg)
+{
+	uint64_t count;
+	while (1)
+	{
+		if (read(wake_fd, &count, sizeof(count)) == -1 && errno != EINTR) return NULL;
+		drain();
+	}
+}
+
+/**
+ * Logs to path from now on. A relative path is taken from the current
+ * directory. NULL turns logging off. Returns -1 if the directory cannot
+ * be opened
+ **/
+int log_set_file(const char * path)
+{
+	int dir = -1;
+	if (path && (dir = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1) return -1;
+	pthread_mutex_lock(&file_lock);
+	if (log_fd >= 0) close(log_fd);
+	if (dir_fd >= 0) close(dir_fd);
+	log_fd = -1;
+	dir_fd = dir;
+	snprintf(log_path, sizeof(log_path), "%s", path ? path : "");
+	pthread_mutex_unlock(&file_lock);
+	return 0;
+}
+
+/**
+ * Current log file, or NULL if logging is off
+ **/
+const char * log_file(void)
+{
+	return log_path[0] ? log_path : NULL;
+}
+
+/**
+ * Starts the writer thread with every signal blocked, so signals sent to
+ * the process (SIGCHLD, SIGHUP, SIGINT while wait runs) always go to the
+ * shell thread and its signalfd. Returns -1 on error
+ **/
+int log_init(const char * path)
+{
+	pthread_t tid;
+	sigset_t all, old;
+	if (log_set_file(path) == -1) return -1;
+	wake_fd = eventfd(0, EFD_CLOEXEC);
+	if (wake_fd < 0) return -1;
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	int r = pthread_create(&tid, NULL, log_writer, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (r != 0)
+	{
+		close(wake_fd);
+		wake_fd = -1;
+		return -1;
+	}
+	pthread_detach(tid);
+	return 0;
+}
+
+/**
+ * Waits (up to a second) until the records queued so far are written
+ **/
+void log_flush(void)
+{
+	if (wake_fd < 0) return;
+	uint64_t end = __atomic_load_n(&head, __ATOMIC_ACQUIRE), one = 1;
+	write(wake_fd, &one, sizeof(one));
+	struct timespec pause = { 0, 1000000 };
+	for (int i = 0; i < 1000 && __atomic_load_n(&tail, __ATOMIC_ACQUIRE) < end; i++)
+		nanosleep(&pause, NULL);
+}
@@ -0,0 +1,56 @@
+/**
+ * Linux Job Control Shell Project
+ * Function prototypes and types for event_log module
+ *
+ * Event log written by a background thread. Producers, signal handlers
+ * included, copy a fixed-size record into a bounded ring and poke an
+ * eventfd; they never block and never do stdio. The writer thread formats
+ * whole batches and appends them with one writev(). Records that find the
+ * ring full are counted as dropped.
+ **/
+#ifndef _EVENT_LOG_H
+#define _EVENT_LOG_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define LOG_RECORDS  1024 /* Ring size, must be a power of two */
+#define LOG_TEXT     40   /* Command name bytes kept per record */
+
+enum log_kind {
+	LOG_JOB,    /* Job state change: pid is the pgid, status an enum status, info its info */
+	LOG_SIGHUP  /* SIGHUP received */
+};
+
+typedef struct
+{
+	uint64_t seq;            /* Index + 1 once written */
+	int64_t ns;              /* CLOCK_REALTIME */
+	int32_t kind;
+	int32_t pid;
+	int32_t status;
+	int32_t info;
+	char text[LOG_TEXT];
+} log_record;
+
+/* Updated with relaxed atomics by the writer thread and the producers: read them with __atomic_load_n */
+typedef struct
+{
+	uint64_t written;  /* Records written to the file */
+	uint64_t dropped;  /* Ring full or no file */
+	uint64_t batches;  /* writev() calls */
+	uint64_t errors;   /* Failed writes */
+} log_counters;
+
+extern log_counters log_stats;
+
+/**
+ * Public Functions
+ **/
+int log_init(const char * path);
+int log_set_file(const char * path);
+const char * log_file(void);
+void log_event(enum log_kind kind, pid_t pid, int status, int info, const char * text);
+void log_flush(void);
+
+#endif
@@ -0,0 +1,132 @@
+/**
+ * Linux Job Control Shell Project
+ * event_loop module
+ *
+ * Callbacks are kept in a table indexed by fd. A callback may add or remove
+ * other fds: events already returned by epoll_wait for a removed fd are
+ * skipped.
+ **/
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "event_loop.h"
+
+#define EV_BATCH 64 /* Max events returned by one epoll_wait */
+
+typedef struct
+{
+	ev_callback cb;
+	void *data;
+} ev_handler;
+
+static int epfd = -1;
+static ev_handler *handlers = NULL;
+static int nhandlers = 0;
+static uint64_t woken;       /* When the last epoll_wait returned, CLOCK_MONOTONIC ns */
+
+/**
+ * Creates the epoll instance. Returns -1 on error
+ **/
+int ev_init(void)
+{
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	return epfd < 0 ? -1 : 0;
+}
+
+/**
+ * Watches fd for events and calls cb when it is ready.
+ * Returns -1 on error (errno set by epoll_ctl, EPERM for regular files)
+ **/
+int ev_add(int fd, uint32_t events, ev_callback cb, void *data)
+{
+	if (fd >= nhandlers)
+	{
+		int n = nhandlers ? nhandlers : 64;
+		while (n <= fd) n *= 2;
+		ev_handler *aux = (ev_handler *) realloc(handlers, n * sizeof(ev_handler));
+		if (!aux) return -1;
+		memset(aux + nhandlers, 0, (n - nhandlers) * sizeof(ev_handler));
+		handlers = aux;
+		nhandlers = n;
+	}
+	struct epoll_event ev = { .events = events, .data.fd = fd };
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1) return -1;
+	handlers[fd].cb = cb;
+	handlers[fd].data = data;
+	return 0;
+}
+
+/**
+ * Changes the events watched for fd (0 pauses it without removing it)
+ **/
+int ev_mod(int fd, uint32_t events)
+{
+	if (fd >= nhandlers || !handlers[fd].cb) return -1;
+	struct epoll_event ev = { .events = events, .data.fd = fd };
+	return epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+/**
+ * Stops watching fd. Must be called before closing it
+ **/
+int ev_del(int fd)
+{
+	if (fd >= nhandlers || !handlers[fd].cb) return -1;
+	handlers[fd].cb = NULL;
+	handlers[fd].data = NULL;
+	return epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+/**
+ * Waits up to timeout_ms (-1 forever) and dispatches the ready events.
+ * Returns the number of callbacks run, or -1 on error
+ **/
+int ev_run_once(int timeout_ms)
+{
+	struct epoll_event events[EV_BATCH];
+	int n = epoll_wait(epfd, events, EV_BATCH, timeout_ms);
+	if (n < 0) return errno == EINTR ? 0 : -1;
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	woken = t.tv_sec * 1000000000ULL + t.tv_nsec;
+
+	int ran = 0;
+	for (int i = 0; i < n; i++)
+	{
+		int fd = events[i].data.fd;
+		if (fd < nhandlers && handlers[fd].cb)
+		{
+			handlers[fd].cb(fd, events[i].events, handlers[fd].data);
+			ran++;
+		}
+	}
+	return ran;
+}
+
+/**
+ * Returns when the events being dispatched were taken from epoll_wait,
+ * in CLOCK_MONOTONIC ns (the clock of stats_now()). Callbacks use it to
+ * count the time their event waited behind the ones dispatched before it
+ **/
+uint64_t ev_woken(void)
+{
+	return woken;
+}
+
+/**
+ * Returns a pidfd for the process pid, readable once it terminates.
+ * Returns -1 if the kernel has no pidfd support (before Linux 5.3)
+ **/
+int pidfd_open_job(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+	return (int) syscall(SYS_pidfd_open, pid, 0);
+#else
+	(void) pid;
+	errno = ENOSYS;
+	return -1;
+#endif
+}
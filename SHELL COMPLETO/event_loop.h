@@ -0,0 +1,29 @@
+/**
+ * Linux Job Control Shell Project
+ * Function prototypes and type declarations for event_loop module
+ *
+ * Single epoll loop for the shell: stdin, the signalfd for SIGCHLD/SIGHUP,
+ * the pidfd of every job and any other event source are dispatched from here.
+ **/
+#ifndef _EVENT_LOOP_H
+#define _EVENT_LOOP_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/epoll.h>
+
+/* Callback invoked with the ready fd, the epoll events and the registered data */
+typedef void (*ev_callback)(int fd, uint32_t events, void *data);
+
+/**
+ * Public Functions
+ **/
+int ev_init(void);
+int ev_add(int fd, uint32_t events, ev_callback cb, void *data);
+int ev_mod(int fd, uint32_t events);
+int ev_del(int fd);
+int ev_run_once(int timeout_ms);
+uint64_t ev_woken(void);
+int pidfd_open_job(pid_t pid);
+
+#endif
@@ -0,0 +1,25 @@
+/**
+ * Linux Job Control Shell Project
+ * Function prototypes for file_count module
+ *
+ * Native fico: counts the regular files whose names start with a prefix,
+ * reading directories with getdents64() instead of starting
+ * ls | grep | awk | grep | wc from cuentafich.sh.
+ *
+ *   fico [-r] [-j threads] [prefix]
+ *
+ * -r descends into subdirectories (symbolic links are not followed), which
+ * are shared out among the threads, as are the entries of a large directory
+ * once read (-j, one per CPU by default; small directories use just one).
+ * Exit status 0 if any file matched, 1 if none did, as the script did.
+ **/
+#ifndef _FILE_COUNT_H
+#define _FILE_COUNT_H
+
+/**
+ * Public Functions
+ **/
+long file_count(const char * dir, const char * prefix, int recursive, int threads);
+int file_count_run(char ** argv);
+
+#endif
@@ -14,13 +14,113 @@ Nombre: Borja Cuenca Páez
  * Some code adapted from "Operating System Concepts Essentials", Silberschatz et al.
  **/
 #include "job_control.h"
+#include "mem_pool.h"
+#include <errno.h>
+#include <stdint.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#define READER_CHUNK 4096
+
+/**
+ * Initializes a line reader on fd, or on a copy of text if fd is -1.
+ * Returns 0 if memory allocation fails
+ **/
+int init_line_reader(line_reader * in, int fd, const char * text)
+{
+	in->fd = fd;
+	in->cap = fd < 0 ? strlen(text) + 2 : READER_CHUNK;
+	in->buf = (char *) malloc(in->cap);
+	if (!in->buf) return 0;
+	in->start = in->end = in->scan = 0;
+	in->eof = fd < 0;
+	if (fd < 0)
+	{
+		in->end = strlen(text);
+		memcpy(in->buf, text, in->end);
+	}
+	return 1;
+}
+
+/**
+ * Returns the next line, '\n' included (one is added to a last line
+ * without it), and its length in *length. The line stays valid until the
+ * next call. Returns NULL at end of input (*length 0) or on a read error
+ * (*length -1).
+ **/
+char * read_line(line_reader * in, int * length)
+{
+	while (1)
+	{
+		char * nl = (char *) memchr(in->buf + in->scan, '\n', in->end - in->scan);
+		if (nl)
+		{
+			char * line = in->buf + in->start;
+			*length = nl - line + 1;
+			in->start = in->scan = nl - in->buf + 1;
+			return line;
+		}
+		in->scan = in->end;
+
+		/* Make room at the end: drop returned lines first, then grow */
+		if (in->start > 0)
+		{
+			memmove(in->buf, in->buf + in->start, in->end - in->start);
+			in->end -= in->start;
+			in->scan -= in->start;
+			in->start = 0;
+		}
+		if (in->end == in->cap)
+		{
+			char * aux = (char *) realloc(in->buf, in->cap * 2);
+			if (!aux)
+			{
+				*length = -1;
+				return NULL;
+			}
+			in->buf = aux;
+			in->cap *= 2;
+		}
+
+		if (in->eof)
+		{
+			if (in->end == in->start)
+			{
+				*length = 0;
+				return NULL;
+			}
+			in->buf[in->end++] = '\n'; /* Last line without newline */
+			continue;
+		}
+
+		ssize_t n = read(in->fd, in->buf + in->end, in->cap - in->end);
+		if (n > 0) in->end += n;
+		else if (n == 0) in->eof = 1;
+		else if (errno != EINTR)
+		{
+			*length = -1;
+			return NULL;
+		}
+	}
+}
+
+/**
+ * Returns 1 if read_line() can return without reading from the fd
+ **/
+int line_ready(line_reader * in)
+{
+	return (in->eof && in->end > in->start) ||
+	       memchr(in->buf + in->scan, '\n', in->end - in->scan) != NULL;
+}
 
 /**
  *  get_command() reads in the next command line, separating it into distinct
  *  tokens using whitespace as delimiters. setup() sets the args parameter as a
- *  null-terminated string.
+ *  null-terminated string. args grows as needed to hold every token.
+ *  Returns 0 at the end of the command stream, 1 otherwise.
  **/
-void get_command(char inputBuffer[], int size, char *args[],int *background)
+int get_command(line_reader * in, char *** args, size_t * args_cap, int *background)
 {
 	int length, /* # of characters in the command line */
 		i,      /* Loop index for accessing inputBuffer array */
@@ -30,20 +130,33 @@ void get_command(char inputBuffer[], int size, char *args[],int *background)
 	ct = 0;
 	*background=0;
 
-	/* Read what the user enters on the command line */
-	length = read(STDIN_FILENO, inputBuffer, size);  
+	/* Read the next whole line, whatever its length */
+	char * inputBuffer = read_line(in, &length);
 
 	start = -1;
 	if (length == 0)
 	{
-		printf("\nBye\n");
-		exit(0);            /* ^d was entered, end of user command stream */
+		return 0;           /* ^d was entered, end of user command stream */
 	} 
 	if (length < 0){
 		perror("error reading the command");
 		exit(-1);           /* Terminate with error code of -1 */
 	}
 
+	/* Every token takes at least 2 chars (itself and a delimiter) */
+	if (*args_cap < (size_t) length / 2 + 2)
+	{
+		char ** aux = (char **) realloc(*args, (length / 2 + 2) * sizeof(char *));
+		if (!aux)
+		{
+			perror("error reading the command");
+			exit(-1);
+		}
+		*args = aux;
+		*args_cap = length / 2 + 2;
+	}
+	char ** argv = *args;
+
 	/* Examine every character in the inputBuffer */
 	int end = 0, iesc=0;
 	for (i=0;i<length;i++) 
@@ -56,7 +169,7 @@ void get_command(char inputBuffer[], int size, char *args[],int *background)
 		case '\t' :               /* Argument separators */
 			if(start != -1)
 			{
-				args[ct] = &inputBuffer[start];    /* Set up pointer */
+				argv[ct] = &inputBuffer[start];    /* Set up pointer */
 				ct++;
 			}
 			inputBuffer[i] = '\0'; /* Add a null char; make a C string */
@@ -73,11 +186,11 @@ void get_command(char inputBuffer[], int size, char *args[],int *background)
 		case '\n':                 /* Should be the final char examined */
 			if (start != -1)
 			{
-				args[ct] = &inputBuffer[start];     
+				argv[ct] = &inputBuffer[start];     
 				ct++;
 			}
 			inputBuffer[i] = '\0';
-			args[ct] = NULL; 	   /* No more arguments to this command */
+			argv[ct] = NULL; 	   /* No more arguments to this command */
 			end = 1;
 			break;
 		default :             /* Some other character */
@@ -86,18 +199,19 @@ void get_command(char inputBuffer[], int size, char *args[],int *background)
 				*background  = 1;
 				if (start != -1)
 				{
-					args[ct] = &inputBuffer[start];     
+					argv[ct] = &inputBuffer[start];     
 					ct++;
 				}
 				inputBuffer[i] = '\0';
-				args[ct] = NULL; /* No more arguments to this command */
+				argv[ct] = NULL; /* No more arguments to this command */
 				i=length; 		 /* Make sure the for loop ends now */
 			}
 			else if (start == -1) start = i;  /* Start of new argument */
 		}  /* End switch */
 	}  /* End for */
-	args[ct] = NULL; /* Just in case the input line was > MAXLINE */
-	if (i>1 && i>iesc) inputBuffer[i-1-iesc] = inputBuffer[i-1];
+	argv[ct] = NULL; /* Just in case the line ended without a delimiter */
+	if (i>1 && i>iesc && i<=length) inputBuffer[i-1-iesc] = inputBuffer[i-1];
+	return 1;
 }
 
 /**
@@ -154,6 +268,388 @@ void parse_redirections(char **args,  char **file_in, char **file_out, char **fi
 	 */
 }
 
+/**
+ * Job records are recycled through a free list instead of being malloc'ed and
+ * freed one by one. The pool grows JOB_POOL_CHUNK records at a time.
+ **/
+#define JOB_POOL_CHUNK 64
+#define JOB_HASH_MIN   64
+#define JOB_SLOTS_MIN  64
+
+static job * job_pool = NULL;
+static proc * proc_pool = NULL;
+
+static job * job_alloc(void)
+{
+	if (!job_pool)
+	{
+		job * chunk = (job *) malloc(JOB_POOL_CHUNK * sizeof(job));
+		if (!chunk) return NULL;
+		mem_stats.pool_refills++;
+		for (int i = 0; i < JOB_POOL_CHUNK; i++)
+		{
+			chunk[i].next = job_pool;
+			job_pool = &chunk[i];
+		}
+	}
+	job * aux = job_pool;
+	job_pool = aux->next;
+	return aux;
+}
+
+static proc * proc_alloc(void)
+{
+	if (!proc_pool)
+	{
+		proc * chunk = (proc *) malloc(JOB_POOL_CHUNK * sizeof(proc));
+		if (!chunk) return NULL;
+		mem_stats.pool_refills++;
+		for (int i = 0; i < JOB_POOL_CHUNK; i++)
+		{
+			chunk[i].next = proc_pool;
+			proc_pool = &chunk[i];
+		}
+	}
+	proc * aux = proc_pool;
+	proc_pool = aux->next;
+	return aux;
+}
+
+/**
+ * Frees an item that is not in any list (add_job failed or was never called)
+ **/
+void free_job(job * item)
+{
+	if (item->command != item->cmd_buf) slab_free(item->command);
+	item->next = job_pool;
+	job_pool = item;
+}
+
+static unsigned pgid_hash(pid_t pid, unsigned nbuckets)
+{
+	return ((unsigned) pid * 2654435761u) & (nbuckets - 1);
+}
+
+/**
+ * Doubles the hash index when the load factor goes over 1
+ **/
+static int grow_buckets(job_registry * reg)
+{
+	unsigned n = reg->nbuckets * 2;
+	job ** buckets = (job **) calloc(n, sizeof(job *));
+	if (!buckets) return 0;
+	for (unsigned b = 0; b < reg->nbuckets; b++)
+	{
+		job * aux = reg->buckets[b];
+		while (aux)
+		{
+			job * hnext = aux->hnext;
+			unsigned h = pgid_hash(aux->pgid, n);
+			aux->hnext = buckets[h];
+			buckets[h] = aux;
+			aux = hnext;
+		}
+	}
+	free(reg->buckets);
+	reg->buckets = buckets;
+	reg->nbuckets = n;
+	return 1;
+}
+
+/**
+ * Same as grow_buckets() for the pid index
+ **/
+static int grow_pbuckets(job_registry * reg)
+{
+	unsigned n = reg->npbuckets * 2;
+	proc ** buckets = (proc **) calloc(n, sizeof(proc *));
+	if (!buckets) return 0;
+	for (unsigned b = 0; b < reg->npbuckets; b++)
+	{
+		proc * aux = reg->pbuckets[b];
+		while (aux)
+		{
+			proc * hnext = aux->hnext;
+			unsigned h = pgid_hash(aux->pid, n);
+			aux->hnext = buckets[h];
+			buckets[h] = aux;
+			aux = hnext;
+		}
+	}
+	free(reg->pbuckets);
+	reg->pbuckets = buckets;
+	reg->npbuckets = n;
+	return 1;
+}
+
+/**
+ * Unlinks a process from the pid index and gives it back to the pool
+ **/
+static void unindex_process(job_registry * reg, proc * p)
+{
+	proc ** link = &reg->pbuckets[pgid_hash(p->pid, reg->npbuckets)];
+	while (*link != p) link = &(*link)->hnext;
+	*link = p->hnext;
+	reg->nprocs--;
+	p->next = proc_pool;
+	proc_pool = p;
+}
+
+/**
+ * Single pass tokenizer. Bytes that need attention (blanks, '\n', '#', '&',
+ * '|', '<', '>', quotes and '\\') are located SCAN_WIDTH bytes at a time
+ * with vector compares; the bytes in between are plain word characters and
+ * are only moved when quotes or escapes have been removed before them.
+ **/
+#if defined(__AVX2__)
+#define SCAN_WIDTH 32
+typedef uint32_t scan_mask;
+static inline scan_mask special_mask(const char * p)
+{
+	__m256i v = _mm256_loadu_si256((const __m256i *) p);
+	__m256i m = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+	m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+	m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+	m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('#')));
+	m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('&')));
+	m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('|')));
+	m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('<')));
+	m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('>')));
+	m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\'')));
+	m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+	m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+	return (scan_mask) _mm256_movemask_epi8(m);
+}
+#elif defined(__SSE2__)
+#define SCAN_WIDTH 16
+typedef uint32_t scan_mask;
+static inline scan_mask special_mask(const char * p)
+{
+	__m128i v = _mm_loadu_si128((const __m128i *) p);
+	__m128i m = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('#')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('&')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('|')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('<')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('>')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\'')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+	return (scan_mask) _mm_movemask_epi8(m);
+}
+#else
+#define SCAN_WIDTH 8
+typedef uint32_t scan_mask;
+static inline int is_special(char c);
+static inline scan_mask special_mask(const char * p)
+{
+	scan_mask m = 0;
+	for (int i = 0; i < SCAN_WIDTH; i++) m |= (scan_mask) is_special(p[i]) << i;
+	return m;
+}
+#endif
+
+static inline int is_special(char c)
+{
+	switch (c)
+	{
+	case ' ': case '\t': case '\n': case '#': case '&': case '|':
+	case '<': case '>': case '\'': case '"': case '\\':
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/* Separator between pipeline stages in command_line argv, compared by address */
+char pipe_token[] = "|";
+
+/**
+ * Grows one of the command_line arrays: from cmd->mem when it has an arena
+ * (the old block is simply left there until the arena is reset), with
+ * realloc() otherwise
+ **/
+static void * grow_array(command_line * cmd, void * old, size_t old_bytes, size_t new_bytes)
+{
+	if (!cmd->mem) return realloc(old, new_bytes);
+	void * aux = arena_alloc(cmd->mem, new_bytes);
+	if (aux && old_bytes) memcpy(aux, old, old_bytes);
+	return aux;
+}
+
+static int push_arg(command_line * cmd, char * arg)
+{
+	if ((size_t) cmd->argc + 1 >= cmd->argv_cap)
+	{
+		size_t n = cmd->argv_cap ? 2 * cmd->argv_cap : 16;
+		char ** aux = (char **) grow_array(cmd, cmd->argv, cmd->argc * sizeof(char *), n * sizeof(char *));
+		if (!aux) return -1;
+		cmd->argv = aux;
+		cmd->argv_cap = n;
+	}
+	cmd->argv[cmd->argc++] = arg;
+	return 0;
+}
+
+static int push_redirection(command_line * cmd, char type, int stage, char * file)
+{
+	if ((size_t) cmd->nredirs >= cmd->redirs_cap)
+	{
+		size_t n = cmd->redirs_cap ? 2 * cmd->redirs_cap : 4;
+		redirection * aux = (redirection *) grow_array(cmd, cmd->redirs, cmd->nredirs * sizeof(redirection), n * sizeof(redirection));
+		if (!aux) return -1;
+		cmd->redirs = aux;
+		cmd->redirs_cap = n;
+	}
+	cmd->redirs[cmd->nredirs++] = (redirection) { type, stage, file };
+	return 0;
+}
+
+/**
+ * Splits line (length bytes, usually ending in '\n') in one pass. Words are
+ * separated by blanks; '#' starts a comment and '&' marks a background
+ * command, both ending the line; '|', '<', '>' and '>>' are operators even
+ * without blanks around them; '...' and "..." group blanks and operators
+ * into a word; '\\' makes the next special character literal.
+ * Redirections go to cmd->redirs with their file instead of into argv.
+ * The line is modified in place and argv points into it.
+ * Returns the number of arguments, or -1 on a syntax error (already reported)
+ **/
+int tokenize_line(char * line, int length, command_line * cmd)
+{
+	int r = 0;            /* Read index */
+	int w = 0;            /* Write index: quotes and escapes are removed in place */
+	int word = -1;        /* Write index where the current word starts, -1 if none */
+	char quote = 0;       /* Quote character we are inside of */
+	char pending = 0;     /* Redirection waiting for its file name */
+	int stage = 0, done = 0;
+
+	cmd->argc = 0;
+	cmd->nredirs = 0;
+	cmd->background = 0;
+	if (cmd->mem)
+	{
+		/* The arrays of the previous line went away with the arena reset */
+		cmd->argv = NULL;
+		cmd->redirs = NULL;
+		cmd->argv_cap = cmd->redirs_cap = 0;
+	}
+
+	while (!done)
+	{
+		/* Next special byte from r */
+		int s = r;
+		while (1)
+		{
+			if (s + SCAN_WIDTH <= length)
+			{
+				scan_mask m = special_mask(line + s);
+				if (!m) { s += SCAN_WIDTH; continue; }
+				s += __builtin_ctz(m);
+			}
+			else
+			{
+				while (s < length && !is_special(line[s])) s++;
+			}
+			/* Inside quotes only the closing quote matters */
+			if (quote && s < length && line[s] != quote) { s++; continue; }
+			break;
+		}
+
+		/* Plain characters: part of the current word */
+		if (s > r)
+		{
+			if (word == -1) word = w;
+			if (w != r) memmove(line + w, line + r, s - r);
+			w += s - r;
+		}
+		r = s;
+		char c = r < length ? line[r] : '\n';
+
+		if (quote)
+		{
+			if (r < length) r++;     /* Closing quote (an unterminated one ends at the line end) */
+			quote = 0;
+			continue;
+		}
+		if (c == '\'' || c == '"')
+		{
+			if (word == -1) word = w; /* "" is an empty word */
+			quote = c;
+			r++;
+			continue;
+		}
+		if (c == '\\')
+		{
+			if (word == -1) word = w;
+			if (r + 1 < length && is_special(line[r + 1]) && line[r + 1] != '\n')
+				r++;                  /* Escaped: keep the next char literally */
+			line[w++] = line[r++];
+			continue;
+		}
+
+		/* Any other special char ends the current word */
+		if (word != -1)
+		{
+			line[w++] = '\0';
+			int bad = pending ? push_redirection(cmd, pending, stage, line + word)
+			                  : push_arg(cmd, line + word);
+			if (bad == -1) return -1;
+			pending = 0;
+			word = -1;
+		}
+		r++;
+
+		switch (c)
+		{
+		case ' ':
+		case '\t':
+			break;
+		case '&':
+			cmd->background = 1;
+			done = 1;
+			break;
+		case '\n':
+		case '#':
+			done = 1;
+			break;
+		default: /* Operators */
+			if (pending || (c == '|' && (cmd->argc == 0 || cmd->argv[cmd->argc - 1] == pipe_token)))
+			{
+				fprintf(stderr, "syntax error near '%c'\n", c);
+				return -1;
+			}
+			if (c == '|')
+			{
+				if (push_arg(cmd, pipe_token) == -1) return -1;
+				stage++;
+			}
+			else if (c == '>' && r < length && line[r] == '>')
+			{
+				pending = 'a';
+				r++;
+			}
+			else pending = c;
+		}
+	}
+
+	if (pending)
+	{
+		fprintf(stderr, "syntax error in redirection\n");
+		return -1;
+	}
+	if (cmd->argc > 0 && cmd->argv[cmd->argc - 1] == pipe_token)
+	{
+		fprintf(stderr, "syntax error in pipeline\n");
+		return -1;
+	}
+	if (push_arg(cmd, NULL) == -1) return -1;
+	cmd->argc--;
+	return cmd->argc;
+}
+
 /**
  * Returns a pointer to a list item with its fields initialized.
  * Returns NULL if memory allocation fails
@@ -161,25 +657,127 @@ void parse_redirections(char **args,  char **file_in, char **file_out, char **fi
 job * new_job(pid_t pid, const char * command, enum job_state state)
 {
 	job * aux;
-	aux=(job *) malloc(sizeof(job));
+	aux=job_alloc();
 	if (!aux) return NULL;
 	aux->pgid=pid;
 	aux->state=state;
-	aux->command=strdup(command);
+	if (strlen(command) < JOB_CMD_INLINE)
+		aux->command=strcpy(aux->cmd_buf, command);
+	else
+		aux->command=slab_strdup(command);
+	aux->pos=0;
 	aux->next=NULL;
+	aux->prev=NULL;
+	aux->hnext=NULL;
+	aux->procs=NULL;
+	aux->nprocs=0;
+	aux->pidfd=-1;
+	aux->team=0;
+	aux->last_pid=pid;
+	aux->exit_status=0;
+	aux->timed=0;
+	aux->client=0;
+	aux->dep=NULL;
+	aux->successors=NULL;
+	aux->waited=0;
+	aux->deadline=0;
+	aux->deadline_slot=-1;
+	aux->timeout_signal=SIGTERM;
+	aux->grace=0;
+	aux->timed_out=0;
+	clock_gettime(CLOCK_MONOTONIC, &aux->start);
+	aux->end=aux->start;
+	memset(&aux->usage, 0, sizeof(aux->usage));
 	return aux;
 }
 
 /**
- * Inserts an item as head of the list
+ * Returns an empty job registry. Its head is used as "job * list" everywhere.
+ * Returns NULL if memory allocation fails
+ **/
+job * new_job_list(const char * name)
+{
+	job_registry * reg = (job_registry *) calloc(1, sizeof(job_registry));
+	if (!reg) return NULL;
+	reg->nslots = JOB_SLOTS_MIN;
+	reg->slots = (job **) calloc(reg->nslots, sizeof(job *));
+	reg->nbuckets = JOB_HASH_MIN;
+	reg->buckets = (job **) calloc(reg->nbuckets, sizeof(job *));
+	reg->npbuckets = JOB_HASH_MIN;
+	reg->pbuckets = (proc **) calloc(reg->npbuckets, sizeof(proc *));
+	reg->head.command = strdup(name);
+	if (!reg->slots || !reg->buckets || !reg->pbuckets || !reg->head.command)
+	{
+		free(reg->slots);
+		free(reg->buckets);
+		free(reg->pbuckets);
+		free(reg->head.command);
+		free(reg);
+		return NULL;
+	}
+	reg->head.state = FOREGROUND;
+	reg->tail = &reg->head;
+	return &reg->head;
+}
+
+/**
+ * Inserts an item at the end of the list and gives it the next job number.
+ * Job numbers do not change while the job stays in the list.
+ * The group leader (pid == pgid) is registered as the first process of the job,
+ * unless pgid is 0: a job that has not started yet (see set_job_pgid).
+ * Returns 0 if memory allocation fails; the item is then left out of the
+ * list and the caller still owns it.
  **/
-void add_job (job * list, job * item)
+int add_job (job * list, job * item)
 {
-	job * aux=list->next;
-	list->next=item;
-	item->next=aux;
+	job_registry * reg = registry_of(list);
+	if (!item) return 0;
+	if (reg->top + 1 >= reg->nslots)
+	{
+		job ** slots = (job **) realloc(reg->slots, 2 * reg->nslots * sizeof(job *));
+		if (!slots) return 0;
+		memset(slots + reg->nslots, 0, reg->nslots * sizeof(job *));
+		reg->slots = slots;
+		reg->nslots *= 2;
+	}
+	if ((unsigned) list->pgid >= reg->nbuckets) grow_buckets(reg);
+	/* Leader first: nothing to undo if it fails */
+	if (!item->procs && item->pgid && !add_process(list, item, item->pgid)) return 0;
+
+	item->pos = ++reg->top;
+	reg->slots[item->pos] = item;
+
+	item->prev = reg->tail;
+	item->next = NULL;
+	reg->tail->next = item;
+	reg->tail = item;
+
+	unsigned h = pgid_hash(item->pgid, reg->nbuckets);
+	item->hnext = reg->buckets[h];
+	reg->buckets[h] = item;
+
 	list->pgid++;
+	return 1;
+}
+
+/**
+ * Gives a job added with pgid 0 its process group once it has started,
+ * keeping its job number, and registers the leader as its first process.
+ * Returns 0 if memory allocation fails
+ **/
+int set_job_pgid(job * list, job * item, pid_t pgid)
+{
+	job_registry * reg = registry_of(list);
+	job ** link = &reg->buckets[pgid_hash(item->pgid, reg->nbuckets)];
+	while (*link != item) link = &(*link)->hnext;
+	*link = item->hnext;
 
+	item->pgid = pgid;
+	item->last_pid = pgid;
+	unsigned h = pgid_hash(pgid, reg->nbuckets);
+	item->hnext = reg->buckets[h];
+	reg->buckets[h] = item;
+	return add_process(list, item, pgid);
 }
 
 /**
@@ -188,19 +786,30 @@ void add_job (job * list, job * item)
  **/
 int delete_job(job * list, job * item)
 {
-	job * aux=list;
-	while(aux->next!= NULL && aux->next!= item) aux=aux->next;
-	if(aux->next)
-	{
-		aux->next=item->next;
-		free(item->command);
-		free(item);
-		list->pgid--;
-		return 1;
-	}
-	else
+	job_registry * reg = registry_of(list);
+	if (!item || item->pos < 1 || item->pos > reg->top || reg->slots[item->pos] != item)
 		return 0;
 
+	reg->slots[item->pos] = NULL;
+	while (reg->top > 0 && !reg->slots[reg->top]) reg->top--;
+
+	item->prev->next = item->next;
+	if (item->next) item->next->prev = item->prev;
+	else reg->tail = item->prev;
+
+	job ** link = &reg->buckets[pgid_hash(item->pgid, reg->nbuckets)];
+	while (*link != item) link = &(*link)->hnext;
+	*link = item->hnext;
+
+	while (item->procs)
+	{
+		proc * p = item->procs;
+		item->procs = p->next;
+		unindex_process(reg, p);
+	}
+	free_job(item);
+	list->pgid--;
+	return 1;
 }
 
 /**
@@ -209,23 +818,75 @@ int delete_job(job * list, job * item)
  **/
 job * get_item_bypid  (job * list, pid_t pid)
 {
-	job * aux=list;
-	while(aux->next!= NULL && aux->next->pgid != pid) aux=aux->next;
-	return aux->next;
+	job_registry * reg = registry_of(list);
+	job * aux = reg->buckets[pgid_hash(pid, reg->nbuckets)];
+	while (aux && aux->pgid != pid) aux = aux->hnext;
+	return aux;
 }
 
 /**
- * Looks an item up by its position inside the list, beginning with 1 (as item 0
- * is devoted to hold the name and number of items of the list), and returns it.
+ * Looks an item up by its job number, beginning with 1 (as item 0 is devoted
+ * to hold the name and number of items of the list), and returns it.
  * Returns NULL if the item is not found.
  **/
 job * get_item_bypos( job * list, int n)
 {
-	job * aux=list;
-	if(n<1 || n>list->pgid) return NULL;
-	n--;
-	while(aux->next!= NULL && n) { aux=aux->next; n--;}
-	return aux->next;
+	job_registry * reg = registry_of(list);
+	if(n<1 || n>reg->top) return NULL;
+	return reg->slots[n];
+}
+
+/**
+ * Registers pid as a live process of the job item.
+ * Returns 0 if memory allocation fails
+ **/
+int add_process(job * list, job * item, pid_t pid)
+{
+	job_registry * reg = registry_of(list);
+	if (reg->nprocs >= (int) reg->npbuckets) grow_pbuckets(reg);
+	proc * p = proc_alloc();
+	if (!p) return 0;
+	p->pid = pid;
+	p->owner = item;
+	p->next = item->procs;
+	item->procs = p;
+	item->nprocs++;
+	unsigned h = pgid_hash(pid, reg->npbuckets);
+	p->hnext = reg->pbuckets[h];
+	reg->pbuckets[h] = p;
+	reg->nprocs++;
+	return 1;
+}
+
+/**
+ * Removes a terminated process from its job.
+ * Returns the number of processes still alive in the job, or -1 if the pid
+ * does not belong to any job of the list. The job itself is not deleted.
+ **/
+int delete_process(job * list, pid_t pid)
+{
+	job_registry * reg = registry_of(list);
+	proc * p = reg->pbuckets[pgid_hash(pid, reg->npbuckets)];
+	while (p && p->pid != pid) p = p->hnext;
+	if (!p) return -1;
+	job * item = p->owner;
+	proc ** link = &item->procs;
+	while (*link != p) link = &(*link)->next;
+	*link = p->next;
+	unindex_process(reg, p);
+	return --item->nprocs;
+}
+
+/**
+ * Looks up the job that owns the process pid.
+ * Returns NULL if the pid does not belong to any job of the list.
+ **/
+job * get_item_byproc(job * list, pid_t pid)
+{
+	job_registry * reg = registry_of(list);
+	proc * p = reg->pbuckets[pgid_hash(pid, reg->npbuckets)];
+	while (p && p->pid != pid) p = p->hnext;
+	return p ? p->owner : NULL;
 }
 
 /**
@@ -237,19 +898,80 @@ void print_item(job * item)
 	printf("pid: %d, command: %s, state: %s\n", item->pgid, item->command, state_strings[item->state]);
 }
 
+static void add_timeval(struct timeval * acc, const struct timeval * t)
+{
+	acc->tv_sec += t->tv_sec;
+	acc->tv_usec += t->tv_usec;
+	if (acc->tv_usec >= 1000000)
+	{
+		acc->tv_sec++;
+		acc->tv_usec -= 1000000;
+	}
+}
+
+/**
+ * Adds the rusage of a reaped process to its job. Times and counters add
+ * up; the job's max RSS is the largest of any of its processes
+ **/
+void add_usage(job * item, const struct rusage * ru)
+{
+	struct rusage * u = &item->usage;
+	add_timeval(&u->ru_utime, &ru->ru_utime);
+	add_timeval(&u->ru_stime, &ru->ru_stime);
+	if (ru->ru_maxrss > u->ru_maxrss) u->ru_maxrss = ru->ru_maxrss;
+	u->ru_minflt += ru->ru_minflt;
+	u->ru_majflt += ru->ru_majflt;
+	u->ru_inblock += ru->ru_inblock;
+	u->ru_oublock += ru->ru_oublock;
+	u->ru_nvcsw += ru->ru_nvcsw;
+	u->ru_nivcsw += ru->ru_nivcsw;
+	clock_gettime(CLOCK_MONOTONIC, &item->end);
+}
+
+/**
+ * Prints wall time (up to now if the job is still in the list and has not
+ * ended), CPU time, max RSS and context switches of a job
+ **/
+void print_usage(job * item)
+{
+	struct rusage * u = &item->usage;
+	struct timespec end = item->end;
+	if (item->nprocs > 0) clock_gettime(CLOCK_MONOTONIC, &end);
+	double real = (end.tv_sec - item->start.tv_sec) + (end.tv_nsec - item->start.tv_nsec) / 1e9;
+	printf("real %.3fs, user %.3fs, sys %.3fs, maxrss %ld KB, ctxsw %ld/%ld, faults %ld/%ld\n", real,
+		u->ru_utime.tv_sec + u->ru_utime.tv_usec / 1e6, u->ru_stime.tv_sec + u->ru_stime.tv_usec / 1e6,
+		u->ru_maxrss, u->ru_nvcsw, u->ru_nivcsw, u->ru_majflt, u->ru_minflt);
+}
+
+/**
+ * Like print_item, plus the usage of the processes of the job already reaped
+ * and the time left to its deadline, if it has one
+ **/
+void print_item_verbose(job * item)
+{
+	print_item(item);
+	printf("     ");
+	print_usage(item);
+	if (item->deadline)
+	{
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		int64_t left = (int64_t) (item->deadline - (now.tv_sec * 1000000000ULL + now.tv_nsec));
+		printf("     %s in %.3fs\n", item->timed_out ? "SIGKILL" : "timeout", left > 0 ? left / 1e9 : 0.0);
+	}
+}
+
 /**
  * Walks the list and call print function for each item in it
  **/
 void print_list(job * list, void (*print)(job *))
 {
-	int n=1;
 	job * aux=list;
 	printf("Contents of %s:\n",list->command);
 	while(aux->next!= NULL) 
 	{
-		printf(" [%d] ",n);
+		printf(" [%d] ",aux->next->pos);
 		print(aux->next);
-		n++;
 		aux=aux->next;
 	}
 }
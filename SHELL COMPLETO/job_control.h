@@ -22,15 +22,34 @@ Nombre: Borja Cuenca Páez
 #include <unistd.h>
 #include <termios.h>
 #include <signal.h>
+#include <stdint.h>
+#include <time.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
+#include "launch.h"
 
 /**
  * Enumerations
  **/
 enum status { SUSPENDED, SIGNALED, EXITED, CONTINUED};
-enum job_state { FOREGROUND, BACKGROUND, STOPPED };
+enum job_state { FOREGROUND, BACKGROUND, STOPPED, WAITING };
 static char* status_strings[] = { "Suspended", "Signaled", "Exited", "Continued"};
-static char* state_strings[] = { "Foreground", "Background", "Stopped" };
+static char* state_strings[] = { "Foreground", "Background", "Stopped", "Waiting" };
+
+#define JOB_CMD_INLINE 40 /* Command names shorter than this live inside the job record */
+
+struct job_;
+struct dep_;
+struct dep_edge_;
+
+/* Live process of a job, indexed by pid so the reaper can find its job */
+typedef struct proc_
+{
+	pid_t pid;
+	struct job_ *owner;  /* Job the process belongs to */
+	struct proc_ *next;  /* Next process of the same job */
+	struct proc_ *hnext; /* Next process in the same pid hash bucket */
+} proc;
 
 /* Job type for job list */
 typedef struct job_
@@ -38,28 +57,122 @@ typedef struct job_
 	pid_t pgid; /* Group id = process lider id */
 	char * command; /* Program name */
 	enum job_state state;
-	struct job_ *next; /* Next job in the list */
+	int pos;            /* Stable job number, index in the registry slot array */
+	struct job_ *next;  /* Next job in the list */
+	struct job_ *prev;  /* Previous job in the list (the head for the first one) */
+	struct job_ *hnext; /* Next job in the same pgid hash bucket */
+	proc *procs;        /* Live processes of the job */
+	int nprocs;         /* Number of live processes */
+	int pidfd;          /* pidfd of the group leader watched by the shell, -1 if none */
+	int team;           /* bgteam/parallel run queue the job belongs to, 0 if none */
+	pid_t last_pid;     /* Last stage of a pipeline, its status is the job status */
+	int exit_status;    /* Status returned by wait for last_pid once reaped */
+	int timed;          /* Started by the time builtin: its usage is printed when it ends */
+	int client;         /* Daemon mode client that submitted the job, 0 if none */
+	struct dep_ *dep;   /* WAITING job: what it waits for and what it will run (after builtin) */
+	struct dep_edge_ *successors; /* WAITING jobs that depend on this one */
+	int waited;         /* Marked by the wait builtin */
+	uint64_t deadline;  /* CLOCK_MONOTONIC ns when the watchdog acts on the job, 0 if none (timeout builtin) */
+	int deadline_slot;  /* Position in the watchdog heap, -1 if not there */
+	int timeout_signal; /* Sent to the group at the deadline */
+	uint64_t grace;     /* ns from timeout_signal to SIGKILL, 0 for none */
+	int timed_out;      /* 1 once timeout_signal was sent, 2 after the SIGKILL */
+	launch_limits limits; /* Resource limits given to its processes (limit builtin) */
+	struct timespec start; /* CLOCK_MONOTONIC when the job was created */
+	struct timespec end;   /* When its last process was reaped */
+	struct rusage usage;   /* Sum of the rusage of its reaped processes (max of ru_maxrss) */
+	char cmd_buf[JOB_CMD_INLINE]; /* Inline storage for short command names */
 } job;
 
+/**
+ * Job registry. The list head returned by new_list() is the first member, so
+ * every function and macro taking a "job * list" works on it unchanged:
+ *   - head.pgid holds the number of jobs and head.command the list name
+ *   - slots[n] is job number n (dense array, numbers do not shift)
+ *   - buckets is a hash index by pgid, pbuckets a hash index by process pid
+ **/
+typedef struct job_registry_
+{
+	job head;          /* Must be the first member */
+	job * tail;        /* Last (most recently added) job */
+	job ** slots;      /* slots[1..top] indexed by job number, slot 0 unused */
+	int nslots;        /* Capacity of slots */
+	int top;           /* Highest job number in use */
+	job ** buckets;    /* pgid hash index */
+	unsigned nbuckets; /* Number of buckets, always a power of two */
+	proc ** pbuckets;  /* pid hash index */
+	unsigned npbuckets;
+	int nprocs;        /* Number of processes in the pid index */
+} job_registry;
+
 /* Type for job list iterator */
 typedef job * job_iterator;
 
+/* Buffered reader that returns whole lines of any length */
+typedef struct
+{
+	int fd;       /* Input fd, -1 when reading a fixed string (-c) */
+	char * buf;   /* Data read and not returned yet is buf[start..end) */
+	size_t cap;
+	size_t start;
+	size_t end;
+	size_t scan;  /* buf[start..scan) is known to have no '\n' */
+	int eof;
+} line_reader;
+
+/* Redirection found by tokenize_line() */
+typedef struct
+{
+	char type;   /* '<', '>' or 'a' for '>>' */
+	int stage;   /* Pipeline stage it belongs to, 0 for the first */
+	char * file;
+} redirection;
+
+extern char pipe_token[]; /* "|" separator emitted by tokenize_line() */
+
+/* Command line split by tokenize_line(). Arrays grow and are reused between
+ * calls, or are taken from an arena that the caller resets after each line */
+typedef struct
+{
+	struct arena_ * mem;   /* Arena for argv and redirs, NULL to use realloc() */
+	char ** argv;          /* NULL terminated, pipe_token separates pipeline stages */
+	size_t argv_cap;
+	int argc;
+	redirection * redirs;
+	size_t redirs_cap;
+	int nredirs;
+	int background;        /* The line ended with '&' */
+} command_line;
+
 /**
  * Public Functions
  **/
-void get_command(char inputBuffer[], int size, char *args[],int *background);
+int init_line_reader(line_reader * in, int fd, const char * text);
+char * read_line(line_reader * in, int * length);
+int line_ready(line_reader * in);
+int get_command(line_reader * in, char *** args, size_t * args_cap, int *background);
 void parse_redirections(char **args,  char **file_in, char **file_out, char **file_ap);
+int tokenize_line(char * line, int length, command_line * cmd);
 job * new_job(pid_t pid, const char * command, enum job_state state);
-void add_job(job * list, job * item);
+job * new_job_list(const char * name);
+void free_job(job * item);
+int add_job(job * list, job * item);
+int set_job_pgid(job * list, job * item, pid_t pgid);
 int delete_job(job * list, job * item);
 job * get_item_bypid(job * list, pid_t pid);
 job * get_item_bypos(job * list, int n);
+int add_process(job * list, job * item, pid_t pid);
+int delete_process(job * list, pid_t pid);
+job * get_item_byproc(job * list, pid_t pid);
 enum status analyze_status(int status, int *info);
+void add_usage(job * item, const struct rusage * ru);
+void print_usage(job * item);
 
 /**
  * Private Functions: Better use through macros below
  **/
 void print_item(job * item);
+void print_item_verbose(job * item);
 void print_list(job * list, void (*print)(job *));
 void terminal_signals(void (*func) (int));
 void block_signal(int signal, int block);
@@ -71,13 +184,16 @@ void block_signal(int signal, int block);
 #define list_size(list)    list->pgid     /* Number of jobs in the list */
 #define empty_list(list)   !(list->pgid)  /* Returns 1 (true) if the list is empty */
 
-#define new_list(name)     new_job(0,name,FOREGROUND)  /* Name must be const char * */
+#define new_list(name)     new_job_list(name)  /* Name must be const char * */
+#define registry_of(list)  ((job_registry *) (list))
+#define current_job(list)  (empty_list(list) ? NULL : registry_of(list)->tail) /* Most recent job */
 
 #define get_iterator(list)   list->next   /* Return pointer to first job */
 #define has_next(iterator)   iterator     /* Return pointer to next job */
 #define next(iterator)       ({job_iterator old = iterator; iterator = iterator->next; old;}) /* Updates iterator to point to next job */
 
 #define print_job_list(list)   print_list(list, print_item)
+#define print_job_list_verbose(list)   print_list(list, print_item_verbose)
 
 #define restore_terminal_signals()  terminal_signals(SIG_DFL)
 #define ignore_terminal_signals() 	terminal_signals(SIG_IGN)
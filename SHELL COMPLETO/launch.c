@@ -0,0 +1,505 @@
+/**
+ * Linux Job Control Shell Project
+ * launch module
+ *
+ * The child side only uses async-signal-safe calls (no stdio, no malloc) so
+ * the same code runs after fork() and inside a CLONE_VM|CLONE_VFORK child,
+ * which shares the shell memory until it calls exec or _exit. Errors are
+ * reported back to the parent in the spec: directly through the shared
+ * memory in vfork mode, through a close-on-exec pipe in fork mode.
+ **/
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include "launch.h"
+#include "job_control.h"
+#include "zygote.h"
+
+#define CHILD_STACK_SIZE (64 * 1024)
+#define PATH_BUCKETS     256 /* Power of two */
+
+enum launch_mode launch_mode = LAUNCH_FORK;
+
+/* Error record sent from the child in fork mode */
+typedef struct
+{
+	int err;
+	int step; /* 0: redirection, 1: exec, 2: placement, 3: limits */
+} launch_error;
+
+static const char * step_names[] = { "redirection", "exec", "placement", "limits" };
+
+/**
+ * Opens path with flags and moves it to target_fd. Returns -1 on error
+ **/
+static int redirect(const char * path, int flags, int target_fd)
+{
+	int fd = open(path, flags, 0666);
+	if (fd == -1) return -1;
+	if (fd != target_fd)
+	{
+		if (dup2(fd, target_fd) == -1) return -1;
+		close(fd);
+	}
+	return 0;
+}
+
+/**
+ * Child side before exec: process group, terminal, signals, pipes and
+ * redirections. Returns -1 with errno set if a redirection fails.
+ * Pipe ends are close-on-exec, so only the dup2'ed copies survive exec.
+ **/
+static int child_setup(launch_spec * spec)
+{
+	pid_t pgid = spec->pgid ? spec->pgid : getpid();
+	setpgid(0, pgid);
+	if (spec->foreground) set_terminal(pgid); /* Before restoring SIGTTOU */
+	restore_terminal_signals();
+	if (spec->sigmask) sigprocmask(SIG_SETMASK, spec->sigmask, NULL);
+
+	if (spec->fd_in > 0 && dup2(spec->fd_in, STDIN_FILENO) == -1) return -1;
+	if (spec->fd_out > 0 && dup2(spec->fd_out, STDOUT_FILENO) == -1) return -1;
+	if (spec->fd_err > 0 && dup2(spec->fd_err, STDERR_FILENO) == -1) return -1;
+	if (spec->file_in && redirect(spec->file_in, O_RDONLY, STDIN_FILENO) == -1) return -1;
+	if (spec->file_out && redirect(spec->file_out, O_WRONLY | O_CREAT | O_TRUNC, STDOUT_FILENO) == -1) return -1;
+	if (spec->file_ap && redirect(spec->file_ap, O_WRONLY | O_CREAT | O_APPEND, STDOUT_FILENO) == -1) return -1;
+	return 0;
+}
+
+/**
+ * Child side: CPU affinity, scheduling policy and nice value.
+ * Returns -1 with errno set if the kernel refuses one of them
+ **/
+static int child_place(const launch_place * place)
+{
+	if (place == NULL) return 0;
+	if (place->has_cpus && sched_setaffinity(0, sizeof(cpu_set_t), &place->cpus) == -1) return -1;
+	if (place->has_policy)
+	{
+		struct sched_param param = { 0 };
+		if (sched_setscheduler(0, place->policy, &param) == -1) return -1;
+	}
+	if (place->has_nice && setpriority(PRIO_PROCESS, 0, place->nice) == -1) return -1;
+	return 0;
+}
+
+/**
+ * Child side: setup and exec.
+ * Only returns on error, with the failed step in *step and errno set.
+ **/
+static void child_exec(launch_spec * spec, int * step)
+{
+	*step = 2;
+	if (child_place(spec->place) == -1) return;
+
+	*step = 3;
+	if (apply_limits(0, spec->limits) == -1) return;
+
+	*step = 0;
+	if (child_setup(spec) == -1) return;
+
+	*step = 1;
+	if (spec->file)
+	{
+		execv(spec->file, spec->argv);
+		if (errno != ENOEXEC) return;
+		/* Script without #!: execvp runs it with /bin/sh, execv does not */
+	}
+	execvp(spec->argv[0], spec->argv);
+}
+
+/**
+ * Entry point of the CLONE_VM|CLONE_VFORK child. The parent is suspended
+ * until exec or _exit, so writing the result into the spec is safe.
+ **/
+static int vfork_child(void * arg)
+{
+	launch_spec * spec = (launch_spec *) arg;
+	int step;
+	child_exec(spec, &step);
+	spec->err = errno;
+	spec->failed = step_names[step];
+	_exit(EXIT_FAILURE);
+}
+
+static pid_t launch_vfork(launch_spec * spec)
+{
+	/* One stack is enough: the parent does not run while the child uses it */
+	static char * stack = NULL;
+	if (!stack)
+	{
+		stack = mmap(NULL, CHILD_STACK_SIZE, PROT_READ | PROT_WRITE,
+		             MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+		if (stack == MAP_FAILED)
+		{
+			stack = NULL;
+			return -1;
+		}
+	}
+	return clone(vfork_child, stack + CHILD_STACK_SIZE, CLONE_VM | CLONE_VFORK | SIGCHLD, spec);
+}
+
+static pid_t launch_fork(launch_spec * spec)
+{
+	int report[2];
+	if (pipe2(report, O_CLOEXEC) == -1) return -1;
+
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		launch_error e;
+		close(report[0]);
+		child_exec(spec, &e.step);
+		e.err = errno;
+		write(report[1], &e, sizeof(e));
+		_exit(EXIT_FAILURE);
+	}
+	close(report[1]);
+	if (pid > 0)
+	{
+		/* EOF means the exec succeeded and closed the pipe */
+		launch_error e;
+		ssize_t n;
+		while ((n = read(report[0], &e, sizeof(e))) == -1 && errno == EINTR);
+		if (n == sizeof(e))
+		{
+			spec->err = e.err;
+			spec->failed = step_names[e.step];
+		}
+	}
+	close(report[0]);
+	return pid;
+}
+
+/**
+ * Starts the command described by spec with the current launch_mode.
+ * Returns the child pid, or -1 if it could not be created. When the child
+ * was created but failed before exec, spec->err and spec->failed say why;
+ * the child then exits with EXIT_FAILURE and must be reaped as usual.
+ **/
+pid_t launch_command(launch_spec * spec)
+{
+	spec->err = 0;
+	spec->failed = NULL;
+	if (launch_mode == LAUNCH_ZYGOTE)
+	{
+		pid_t pid = zygote_launch(spec);
+		if (pid > 0) return pid;
+	}
+	return launch_mode == LAUNCH_VFORK ? launch_vfork(spec) : launch_fork(spec);
+}
+
+/**
+ * Runs fn(spec->argv) in a forked child set up like a command (process group,
+ * terminal, signals, pipes, redirections) instead of exec'ing a program.
+ * Used for pipeline stages implemented by the shell itself. fork() is used in
+ * every launch_mode because fn runs shell code. The child exits with the
+ * value returned by fn.
+ **/
+pid_t launch_function(launch_spec * spec, int (*fn)(char **))
+{
+	spec->err = 0;
+	spec->failed = NULL;
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		if (child_place(spec->place) == -1)
+		{
+			perror("Placement error");
+			_exit(EXIT_FAILURE);
+		}
+		if (apply_limits(0, spec->limits) == -1)
+		{
+			perror("Limit error");
+			_exit(EXIT_FAILURE);
+		}
+		if (child_setup(spec) == -1)
+		{
+			perror("Redirection error");
+			_exit(EXIT_FAILURE);
+		}
+		/* No exec closes the close-on-exec descriptors: without this the stage would
+		 * keep its own pipe open (and the other stages' ends) and never see EOF/EPIPE */
+		close_range(3, ~0U, 0);
+		_exit(fn(spec->argv));
+	}
+	return pid;
+}
+
+/**
+ * Returns the launch_mode named name, or -1 if unknown
+ **/
+int parse_launch_mode(const char * name)
+{
+	for (int i = 0; i < (int) (sizeof(launch_mode_strings) / sizeof(launch_mode_strings[0])); i++)
+		if (!strcmp(name, launch_mode_strings[i])) return i;
+	return -1;
+}
+
+/**
+ * PATH lookup cache. Entries are only valid for the PATH they were resolved
+ * with: the whole cache is dropped when PATH changes.
+ **/
+static path_entry * path_buckets[PATH_BUCKETS];
+static char * cached_path_env = NULL;
+
+static unsigned name_hash(const char * name)
+{
+	unsigned h = 2166136261u; /* FNV-1a */
+	while (*name) h = (h ^ (unsigned char) *name++) * 16777619u;
+	return h & (PATH_BUCKETS - 1);
+}
+
+/**
+ * Searches name in the absolute directories of PATH.
+ * Returns a malloc'ed path or NULL if not found
+ **/
+static char * search_path(const char * name, const char * path_env)
+{
+	size_t len = strlen(name);
+	const char * dir = path_env;
+	while (dir && *dir)
+	{
+		const char * end = strchr(dir, ':');
+		size_t dlen = end ? (size_t) (end - dir) : strlen(dir);
+		/* Relative entries ("", ".") depend on the cwd and are not cached */
+		if (dlen > 0 && dir[0] == '/')
+		{
+			char * full = (char *) malloc(dlen + len + 2);
+			if (!full) return NULL;
+			memcpy(full, dir, dlen);
+			full[dlen] = '/';
+			memcpy(full + dlen + 1, name, len + 1);
+			struct stat st;
+			if (stat(full, &st) == 0 && S_ISREG(st.st_mode) && access(full, X_OK) == 0)
+				return full;
+			free(full);
+		}
+		dir = end ? end + 1 : NULL;
+	}
+	return NULL;
+}
+
+/**
+ * Returns the cached full path of command name, resolving it on a miss.
+ * Returns NULL if name contains a '/' or is not found in an absolute PATH
+ * directory: the caller then falls back to execvp().
+ **/
+const char * path_lookup(const char * name)
+{
+	const char * path_env = getenv("PATH");
+	if (strchr(name, '/') || !path_env) return NULL;
+
+	if (!cached_path_env || strcmp(cached_path_env, path_env))
+	{
+		path_clear();
+		cached_path_env = strdup(path_env);
+	}
+
+	unsigned h = name_hash(name);
+	path_entry * aux = path_buckets[h];
+	while (aux && strcmp(aux->name, name)) aux = aux->next;
+	if (aux)
+	{
+		aux->hits++;
+		return aux->path;
+	}
+
+	char * full = search_path(name, path_env);
+	if (!full) return NULL;
+	aux = (path_entry *) malloc(sizeof(path_entry));
+	if (!aux || !(aux->name = strdup(name)))
+	{
+		free(aux);
+		free(full);
+		return NULL;
+	}
+	aux->path = full;
+	aux->hits = 0;
+	aux->next = path_buckets[h];
+	path_buckets[h] = aux;
+	return aux->path;
+}
+
+/**
+ * Drops the entry for name (its cached path no longer exists)
+ **/
+void path_forget(const char * name)
+{
+	path_entry ** link = &path_buckets[name_hash(name)];
+	while (*link && strcmp((*link)->name, name)) link = &(*link)->next;
+	if (*link)
+	{
+		path_entry * aux = *link;
+		*link = aux->next;
+		free(aux->name);
+		free(aux->path);
+		free(aux);
+	}
+}
+
+/**
+ * Empties the cache
+ **/
+void path_clear(void)
+{
+	for (int b = 0; b < PATH_BUCKETS; b++)
+	{
+		while (path_buckets[b])
+		{
+			path_entry * aux = path_buckets[b];
+			path_buckets[b] = aux->next;
+			free(aux->name);
+			free(aux->path);
+			free(aux);
+		}
+	}
+	free(cached_path_env);
+	cached_path_env = NULL;
+}
+
+/**
+ * Prints hits and path of every cached command
+ **/
+void print_path_cache(void)
+{
+	int empty = 1;
+	for (int b = 0; b < PATH_BUCKETS; b++)
+	{
+		for (path_entry * aux = path_buckets[b]; aux; aux = aux->next)
+		{
+			if (empty) printf("hits\tcommand\n");
+			printf("%4lu\t%s\n", aux->hits, aux->path);
+			empty = 0;
+		}
+	}
+	if (empty) printf("hash: hash table empty\n");
+}
+
+/**
+ * Parses a CPU list such as "0-3,8,10-11" (taskset -c syntax).
+ * Returns -1 if it is malformed or names a CPU beyond CPU_SETSIZE
+ **/
+int parse_cpu_list(const char * list, cpu_set_t * cpus)
+{
+	CPU_ZERO(cpus);
+	const char * p = list;
+	while (*p)
+	{
+		char * end;
+		long first = strtol(p, &end, 10), last = first;
+		if (end == p || first < 0) return -1;
+		if (*end == '-')
+		{
+			p = end + 1;
+			last = strtol(p, &end, 10);
+			if (end == p || last < first) return -1;
+		}
+		if (last >= CPU_SETSIZE) return -1;
+		for (long cpu = first; cpu <= last; cpu++) CPU_SET(cpu, cpus);
+		if (*end == ',') end++;
+		else if (*end) return -1;
+		p = end;
+	}
+	return CPU_COUNT(cpus) > 0 ? 0 : -1;
+}
+
+/**
+ * Writes cpus as a list of ranges ("0-3,8"), truncated to size bytes
+ **/
+void format_cpu_list(const cpu_set_t * cpus, char * buf, size_t size)
+{
+	size_t n = 0;
+	buf[0] = '\0';
+	for (int cpu = 0; cpu < CPU_SETSIZE && n < size; cpu++)
+	{
+		if (!CPU_ISSET(cpu, cpus)) continue;
+		int last = cpu;
+		while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, cpus)) last++;
+		n += snprintf(buf + n, size - n, last > cpu ? "%s%d-%d" : "%s%d", n ? "," : "", cpu, last);
+		cpu = last;
+	}
+}
+
+/**
+ * Sets the limits in limits->set on process pid (0 for the caller) as both
+ * soft and hard limit. The CPU hard limit is one second above the soft one,
+ * so the process gets SIGXCPU first and SIGKILL only if it ignores it.
+ * Returns -1 with errno set if the kernel refuses one of them
+ **/
+int apply_limits(pid_t pid, const launch_limits * limits)
+{
+	if (limits == NULL) return 0;
+	for (int i = 0; i < LIMITS; i++)
+	{
+		if (!(limits->set & (1u << i))) continue;
+		struct rlimit rl = { limits->value[i], limits->value[i] };
+		if (i == LIMIT_CPU && rl.rlim_max != RLIM_INFINITY) rl.rlim_max++;
+		if (prlimit(pid, limit_resources[i], &rl, NULL) == -1) return -1;
+	}
+	return 0;
+}
+
+/**
+ * Parses "name=value" (as=512M, cpu=10, nofile=256, nproc=64 or
+ * name=unlimited) into limits. Sizes take a K, M, G or T suffix, seconds an
+ * optional s.
+ * Returns the limit index, or -1 if arg is not a valid limit
+ **/
+int parse_limit(const char * arg, launch_limits * limits)
+{
+	const char * eq = strchr(arg, '=');
+	if (eq == NULL) return -1;
+	for (int i = 0; i < LIMITS; i++)
+	{
+		if (strlen(limit_names[i]) != (size_t) (eq - arg) || strncmp(arg, limit_names[i], eq - arg)) continue;
+		rlim_t value = RLIM_INFINITY;
+		if (strcmp(eq + 1, "unlimited"))
+		{
+			char * end;
+			errno = 0;
+			unsigned long long n = strtoull(eq + 1, &end, 10);
+			int shift = 0;
+			if (i == LIMIT_AS && *end)
+			{
+				const char * p = strchr("KMGT", *end);
+				if (p == NULL) return -1;
+				shift = 10 * (p - "KMGT" + 1);
+				end++;
+			}
+			else if (i == LIMIT_CPU && *end == 's') end++;
+			if (end == eq + 1 || *end || errno || eq[1] == '-' || n > (RLIM_INFINITY - 1) >> shift) return -1;
+			value = (rlim_t) n << shift;
+		}
+		limits->value[i] = value;
+		limits->set |= 1u << i;
+		return i;
+	}
+	return -1;
+}
+
+/**
+ * Writes value of limit as parse_limit() reads it ("512M", "10s", "unlimited")
+ **/
+void format_limit(int limit, rlim_t value, char * buf, size_t size)
+{
+	if (value == RLIM_INFINITY)
+	{
+		snprintf(buf, size, "unlimited");
+		return;
+	}
+	static const char * units[] = { "", "K", "M", "G", "T" };
+	int shift = 0;
+	if (limit == LIMIT_AS)
+		while (shift < 40 && value && (value & ((1ULL << (shift + 10)) - 1)) == 0) shift += 10;
+	snprintf(buf, size, "%llu%s", (unsigned long long) (value >> shift),
+	         limit == LIMIT_CPU ? "s" : units[shift / 10]);
+}
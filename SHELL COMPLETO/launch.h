@@ -0,0 +1,93 @@
+/**
+ * Linux Job Control Shell Project
+ * Function prototypes and type declarations for launch module
+ *
+ * Starts external commands either with fork() or with
+ * clone(CLONE_VM|CLONE_VFORK), which does not copy the shell page tables,
+ * so spawn cost does not grow with the shell RSS, or on a child forked
+ * ahead of time by the zygote pool (zygote.h). The mode is chosen at
+ * runtime through launch_mode.
+ **/
+#ifndef _LAUNCH_H
+#define _LAUNCH_H
+
+#include <sys/types.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/resource.h>
+
+enum launch_mode { LAUNCH_FORK, LAUNCH_VFORK, LAUNCH_ZYGOTE };
+static char* launch_mode_strings[] = { "fork", "vfork", "zygote" };
+
+/* Where and how the child runs (taskset, nice, sched), applied before the redirections */
+typedef struct
+{
+	cpu_set_t cpus;         /* CPU affinity when has_cpus */
+	int has_cpus;
+	int nice;               /* Nice value when has_nice */
+	int has_nice;
+	int policy;             /* SCHED_OTHER, SCHED_BATCH or SCHED_IDLE when has_policy */
+	int has_policy;
+} launch_place;
+
+/* Resource limits of the child (limit builtin), applied with setrlimit before exec
+ * and with prlimit on the processes of a live job */
+enum launch_limit { LIMIT_AS, LIMIT_CPU, LIMIT_NOFILE, LIMIT_NPROC, LIMITS };
+static char* limit_names[] = { "as", "cpu", "nofile", "nproc" };
+static const int limit_resources[] = { RLIMIT_AS, RLIMIT_CPU, RLIMIT_NOFILE, RLIMIT_NPROC };
+
+typedef struct
+{
+	rlim_t value[LIMITS];   /* Soft and hard limit, RLIM_INFINITY for none */
+	unsigned set;           /* Bit (1 << LIMIT_x) when value[LIMIT_x] is applied */
+} launch_limits;
+
+/* What to run and how to set up the child before exec */
+typedef struct
+{
+	char ** argv;           /* NULL terminated argument list */
+	const char * file;      /* Program to exec, NULL to search argv[0] in PATH */
+	const char * file_in;   /* '<' redirection or NULL */
+	const char * file_out;  /* '>' redirection or NULL */
+	const char * file_ap;   /* '>>' redirection or NULL */
+	int fd_in;              /* Pipe read end for stdin, 0 when not in a pipeline */
+	int fd_out;             /* Pipe write end for stdout, 0 when not in a pipeline */
+	int fd_err;             /* Descriptor for stderr (output capture), 0 to inherit the shell one */
+	pid_t pgid;             /* Process group to join, 0 for a new group led by the child */
+	int foreground;         /* Child takes the terminal before exec */
+	const sigset_t * sigmask; /* Signal mask for the child, NULL to keep the shell one */
+	const launch_place * place; /* Placement for the child, NULL to inherit the shell one */
+	const launch_limits * limits; /* Resource limits for the child, NULL to inherit the shell ones */
+	/* Filled in by launch_command() */
+	int err;                /* errno of the failed step, 0 if exec succeeded */
+	const char * failed;    /* Failed step: "redirection", "exec", "placement" or "limits" */
+} launch_spec;
+
+/* Resolved command path cached by name (hash builtin) */
+typedef struct path_entry_
+{
+	char * name;
+	char * path;
+	unsigned long hits;
+	struct path_entry_ * next;
+} path_entry;
+
+extern enum launch_mode launch_mode;
+
+/**
+ * Public Functions
+ **/
+pid_t launch_command(launch_spec * spec);
+pid_t launch_function(launch_spec * spec, int (*fn)(char **));
+int parse_launch_mode(const char * name);
+const char * path_lookup(const char * name);
+void path_forget(const char * name);
+void path_clear(void);
+void print_path_cache(void);
+int parse_cpu_list(const char * list, cpu_set_t * cpus);
+void format_cpu_list(const cpu_set_t * cpus, char * buf, size_t size);
+int apply_limits(pid_t pid, const launch_limits * limits);
+int parse_limit(const char * arg, launch_limits * limits);
+void format_limit(int limit, rlim_t value, char * buf, size_t size);
+
+#endif
@@ -0,0 +1,209 @@
+/**
+ * Linux Job Control Shell Project
+ * mem_pool module
+ **/
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "mem_pool.h"
+
+#define ARENA_ALIGN      16
+#define ARENA_MIN_CHUNK  (16 * 1024)
+#define SLAB_SIZE        (16 * 1024)
+#define SLAB_MIN_SHIFT   4  /* Smallest string block: 16 bytes */
+#define SLAB_CLASSES     8  /* 16 .. 2048 bytes */
+#define SLAB_LARGE       SLAB_CLASSES
+
+/* glibc lets the program replace malloc and reach the real one through
+ * __libc_malloc: every allocation of the process is counted, libc's own
+ * (stdio, strdup, opendir) too. The sanitizers bring their own malloc */
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+#define MEM_HEAP_COUNTED 1
+#else
+#define MEM_HEAP_COUNTED 0
+#endif
+
+mem_counters mem_stats = { .heap_counted = MEM_HEAP_COUNTED };
+
+#if MEM_HEAP_COUNTED
+extern void * __libc_malloc(size_t size);
+extern void * __libc_calloc(size_t n, size_t size);
+extern void * __libc_realloc(void * p, size_t size);
+
+/* Relaxed atomics: the log thread and the fico workers allocate too */
+void * malloc(size_t size)
+{
+	__atomic_fetch_add(&mem_stats.heap_allocs, 1, __ATOMIC_RELAXED);
+	return __libc_malloc(size);
+}
+
+void * calloc(size_t n, size_t size)
+{
+	__atomic_fetch_add(&mem_stats.heap_allocs, 1, __ATOMIC_RELAXED);
+	return __libc_calloc(n, size);
+}
+
+void * realloc(void * p, size_t size)
+{
+	__atomic_fetch_add(&mem_stats.heap_allocs, 1, __ATOMIC_RELAXED);
+	return __libc_realloc(p, size);
+}
+#endif
+
+/**
+ * Allocations counted so far: every heap allocation of the process when
+ * heap_counted, otherwise only the mallocs made by the pools
+ **/
+unsigned long mem_allocations(void)
+{
+	if (mem_stats.heap_counted) return __atomic_load_n(&mem_stats.heap_allocs, __ATOMIC_RELAXED);
+	return mem_stats.arena_chunks + mem_stats.slab_refills + mem_stats.large_allocs + mem_stats.pool_refills;
+}
+
+/* Every slab string is preceded by the index of its size class */
+typedef union slab_block_
+{
+	union slab_block_ * next;  /* While in the free list */
+	size_t cls;                /* While in use */
+	max_align_t align;
+} slab_block;
+
+static slab_block * slab_free_list[SLAB_CLASSES];
+
+static arena_chunk * new_chunk(size_t size)
+{
+	arena_chunk * c = (arena_chunk *) malloc(sizeof(arena_chunk) + size);
+	if (!c) return NULL;
+	c->size = size;
+	c->used = 0;
+	c->next = NULL;
+	mem_stats.arena_chunks++;
+	return c;
+}
+
+/**
+ * Returns size bytes from the arena, aligned to 16.
+ * Returns NULL if memory allocation fails
+ **/
+void * arena_alloc(arena * a, size_t size)
+{
+	size = (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+	arena_chunk * c = a->chunks;
+	if (!c || c->used + size > c->size)
+	{
+		size_t n = a->chunk_size ? a->chunk_size : ARENA_MIN_CHUNK;
+		while (n < size) n *= 2;
+		c = new_chunk(n);
+		if (!c) return NULL;
+		c->next = a->chunks;
+		a->chunks = c;
+	}
+	void * p = c->data + c->used;
+	c->used += size;
+	return p;
+}
+
+/**
+ * Frees everything allocated from the arena in one step.
+ * If the last use needed several chunks they are replaced by one chunk big
+ * enough for all of them, so the same use does not allocate again.
+ **/
+void arena_reset(arena * a)
+{
+	arena_chunk * c = a->chunks;
+	if (!c) return;
+	if (c->next)
+	{
+		size_t total = 0;
+		while (c)
+		{
+			arena_chunk * next = c->next;
+			total += c->size;
+			free(c);
+			c = next;
+		}
+		a->chunk_size = total;
+		a->chunks = new_chunk(total);
+		return;
+	}
+	c->used = 0;
+}
+
+/**
+ * Returns the bytes currently taken from the arena
+ **/
+size_t arena_used(arena * a)
+{
+	size_t n = 0;
+	for (arena_chunk * c = a->chunks; c; c = c->next) n += c->used;
+	return n;
+}
+
+static int size_class(size_t size)
+{
+	int cls = 0;
+	while (cls < SLAB_CLASSES && ((size_t) 1 << (cls + SLAB_MIN_SHIFT)) < size + sizeof(slab_block)) cls++;
+	return cls;
+}
+
+/**
+ * Splits a new slab into free blocks of class cls
+ **/
+static int slab_refill(int cls)
+{
+	size_t block = (size_t) 1 << (cls + SLAB_MIN_SHIFT);
+	char * slab = (char *) malloc(SLAB_SIZE);
+	if (!slab) return 0;
+	mem_stats.slab_refills++;
+	for (size_t off = 0; off + block <= SLAB_SIZE; off += block)
+	{
+		slab_block * b = (slab_block *) (slab + off);
+		b->next = slab_free_list[cls];
+		slab_free_list[cls] = b;
+	}
+	return 1;
+}
+
+/**
+ * strdup() from the slab pool. Give it back with slab_free().
+ * Returns NULL if memory allocation fails
+ **/
+char * slab_strdup(const char * s)
+{
+	size_t len = strlen(s) + 1;
+	int cls = size_class(len);
+	slab_block * b;
+	if (cls == SLAB_LARGE)
+	{
+		b = (slab_block *) malloc(sizeof(slab_block) + len);
+		if (!b) return NULL;
+		mem_stats.large_allocs++;
+	}
+	else
+	{
+		if (!slab_free_list[cls] && !slab_refill(cls)) return NULL;
+		b = slab_free_list[cls];
+		slab_free_list[cls] = b->next;
+	}
+	b->cls = cls;
+	mem_stats.strings_used++;
+	return memcpy((char *) (b + 1), s, len);
+}
+
+/**
+ * Returns a string from slab_strdup() to its size class
+ **/
+void slab_free(char * s)
+{
+	if (!s) return;
+	slab_block * b = (slab_block *) s - 1;
+	mem_stats.strings_used--;
+	if (b->cls == SLAB_LARGE)
+	{
+		free(b);
+		return;
+	}
+	int cls = (int) b->cls;
+	b->next = slab_free_list[cls];
+	slab_free_list[cls] = b;
+}
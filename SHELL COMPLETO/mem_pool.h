@@ -0,0 +1,56 @@
+/**
+ * Linux Job Control Shell Project
+ * Function prototypes and type declarations for mem_pool module
+ *
+ * Per-command bump arena (reset in one step after each command) and a slab
+ * pool of strings for data that outlives a command, such as job names.
+ * mem_stats counts every call these allocators make to malloc and, on
+ * glibc, every malloc/calloc/realloc of the whole process (libc included),
+ * so the steady state can be checked to be allocation free (memstat builtin).
+ **/
+#ifndef _MEM_POOL_H
+#define _MEM_POOL_H
+
+#include <stddef.h>
+
+typedef struct arena_chunk_
+{
+	struct arena_chunk_ * next;
+	size_t size;
+	size_t used;
+	char data[];
+} arena_chunk;
+
+/* Bump allocator: memory is only given back all at once by arena_reset() */
+typedef struct arena_
+{
+	arena_chunk * chunks;  /* Current chunk first */
+	size_t chunk_size;     /* Size of new chunks */
+} arena;
+
+/* Allocations made by the pools */
+typedef struct
+{
+	unsigned long arena_chunks;  /* Chunks malloc'ed by arenas */
+	unsigned long slab_refills;  /* Slabs malloc'ed for a string size class */
+	unsigned long large_allocs;  /* Strings too big for the slabs */
+	unsigned long pool_refills;  /* Job and process record chunks */
+	unsigned long strings_used;  /* Strings currently taken from the slabs */
+	unsigned long heap_allocs;   /* malloc/calloc/realloc calls of the process, if heap_counted */
+	int heap_counted;            /* 0 when only the pools are counted (not glibc, or a sanitizer) */
+} mem_counters;
+
+extern mem_counters mem_stats;
+
+/**
+ * Public Functions
+ **/
+unsigned long mem_allocations(void);
+
+void * arena_alloc(arena * a, size_t size);
+void arena_reset(arena * a);
+size_t arena_used(arena * a);
+char * slab_strdup(const char * s);
+void slab_free(char * s);
+
+#endif
@@ -0,0 +1,207 @@
+/**
+ * Linux Job Control Shell Project
+ * pipe_stage module
+ *
+ * Stages run in a forked child with stdin/stdout already connected to the
+ * pipeline. When neither end is a pipe splice() is not possible and the
+ * copy falls back to sendfile() and then to read()/write().
+ **/
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include "pipe_stage.h"
+
+#define CHUNK      (1 << 16)
+#define MAX_OUTPUT 32 /* Files a tee stage can write to */
+
+static int is_pipe(int fd)
+{
+	struct stat st;
+	return fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+}
+
+/**
+ * Writes the whole buffer. Returns -1 on error
+ **/
+static int write_all(int fd, const char * buf, size_t n)
+{
+	while (n > 0)
+	{
+		ssize_t w = write(fd, buf, n);
+		if (w < 0)
+		{
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		buf += w;
+		n -= w;
+	}
+	return 0;
+}
+
+/**
+ * Moves everything readable from in to out.
+ * Returns the number of bytes copied or -1 on error
+ **/
+ssize_t copy_fd(int in, int out)
+{
+	ssize_t total = 0, n;
+	int use_splice = is_pipe(in) || is_pipe(out), use_sendfile = 1;
+	char buf[CHUNK];
+
+	while (1)
+	{
+		if (use_splice)
+		{
+			n = splice(in, NULL, out, NULL, CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE);
+			if (n < 0 && errno == EINVAL) { use_splice = 0; continue; }
+		}
+		else if (use_sendfile)
+		{
+			n = sendfile(out, in, NULL, CHUNK);
+			if (n < 0 && (errno == EINVAL || errno == ENOSYS)) { use_sendfile = 0; continue; }
+		}
+		else
+		{
+			n = read(in, buf, sizeof(buf));
+			if (n > 0 && write_all(out, buf, n) == -1) return -1;
+		}
+		if (n == 0) return total;
+		if (n < 0)
+		{
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		total += n;
+	}
+}
+
+/**
+ * cat [file...]: copies the files (or stdin) to stdout
+ **/
+static int native_cat(char ** argv)
+{
+	int status = 0;
+	if (!argv[1]) return copy_fd(STDIN_FILENO, STDOUT_FILENO) < 0;
+	for (int i = 1; argv[i]; i++)
+	{
+		int fd = !strcmp(argv[i], "-") ? STDIN_FILENO : open(argv[i], O_RDONLY);
+		if (fd < 0 || copy_fd(fd, STDOUT_FILENO) < 0)
+		{
+			fprintf(stderr, "cat: %s: %s\n", argv[i], strerror(errno));
+			status = 1;
+		}
+		if (fd > STDIN_FILENO) close(fd);
+	}
+	return status;
+}
+
+/**
+ * Consumes exactly n bytes of the pipe in into fd
+ **/
+static int splice_exact(int in, int fd, size_t n)
+{
+	while (n > 0)
+	{
+		ssize_t m = splice(in, NULL, fd, NULL, n, SPLICE_F_MOVE | SPLICE_F_MORE);
+		if (m <= 0)
+		{
+			if (m < 0 && errno == EINTR) continue;
+			return -1;
+		}
+		n -= m;
+	}
+	return 0;
+}
+
+/**
+ * tee [-a] file...: copies stdin to stdout and to every file.
+ * With pipes on both sides, tee(2) duplicates each chunk into stdout without
+ * consuming it, scratch pipes carry the extra copies and the last splice()
+ * consumes the chunk into the last file. Otherwise it reads and writes.
+ **/
+static int native_tee(char ** argv)
+{
+	int fds[MAX_OUTPUT], nfds = 0, flags = O_WRONLY | O_CREAT | O_TRUNC, status = 0;
+	int a = 1;
+	if (argv[a] && !strcmp(argv[a], "-a"))
+	{
+		flags = O_WRONLY | O_CREAT | O_APPEND;
+		a++;
+	}
+	for (; argv[a] && nfds < MAX_OUTPUT; a++)
+	{
+		int fd = open(argv[a], flags, 0666);
+		if (fd < 0)
+		{
+			fprintf(stderr, "tee: %s: %s\n", argv[a], strerror(errno));
+			status = 1;
+		}
+		else fds[nfds++] = fd;
+	}
+
+	if (nfds == 0) return copy_fd(STDIN_FILENO, STDOUT_FILENO) < 0 ? 1 : status;
+
+	int scratch[2] = { -1, -1 };
+	if (is_pipe(STDIN_FILENO) && is_pipe(STDOUT_FILENO) && (nfds == 1 || pipe(scratch) == 0))
+	{
+		while (1)
+		{
+			ssize_t n = tee(STDIN_FILENO, STDOUT_FILENO, CHUNK, 0);
+			if (n == 0) return status;
+			if (n < 0)
+			{
+				if (errno == EINTR) continue;
+				return 1;
+			}
+			/* tee() always starts at the head of the pipe: the scratch pipe is
+			   empty and as large as a chunk, so each copy takes one call */
+			for (int i = 0; i < nfds - 1; i++)
+			{
+				if (tee(STDIN_FILENO, scratch[1], n, 0) != n) return 1;
+				if (splice_exact(scratch[0], fds[i], n) == -1) return 1;
+			}
+			if (splice_exact(STDIN_FILENO, fds[nfds - 1], n) == -1) return 1;
+		}
+	}
+
+	char buf[CHUNK];
+	ssize_t n;
+	while ((n = read(STDIN_FILENO, buf, sizeof(buf))) != 0)
+	{
+		if (n < 0)
+		{
+			if (errno == EINTR) continue;
+			return 1;
+		}
+		if (write_all(STDOUT_FILENO, buf, n) == -1) return 1;
+		for (int i = 0; i < nfds; i++)
+			if (write_all(fds[i], buf, n) == -1) status = 1;
+	}
+	return status;
+}
+
+/**
+ * Returns 1 if argv is a stage the shell can run natively: cat or tee with
+ * file arguments only. With options the real program is run instead
+ **/
+int pipe_stage_native(char ** argv)
+{
+	if (strcmp(argv[0], "cat") && strcmp(argv[0], "tee")) return 0;
+	for (char ** a = argv + 1; *a != NULL; a++)
+		if ((*a)[0] == '-' && (*a)[1] != '\0') return 0; /* "-" alone is stdin for cat */
+	return 1;
+}
+
+/**
+ * Runs a native stage in the current process and returns its exit status
+ **/
+int pipe_stage_run(char ** argv)
+{
+	return !strcmp(argv[0], "cat") ? native_cat(argv) : native_tee(argv);
+}
@@ -0,0 +1,21 @@
+/**
+ * Linux Job Control Shell Project
+ * Function prototypes for pipe_stage module
+ *
+ * Pipeline stages the shell runs itself (cat, tee) moving data between
+ * pipes and files with splice(2)/tee(2), so bytes are not copied through
+ * user space. Enabled with "set splice on".
+ **/
+#ifndef _PIPE_STAGE_H
+#define _PIPE_STAGE_H
+
+#include <sys/types.h>
+
+/**
+ * Public Functions
+ **/
+int pipe_stage_native(char ** argv);
+int pipe_stage_run(char ** argv);
+ssize_t copy_fd(int in, int out);
+
+#endif
@@ -0,0 +1,188 @@
+/**
+ * Linux Job Control Shell Project
+ * proc_scan module
+ *
+ * The fast path reads /proc/self/task/<tid>/children, which lists only the
+ * shell's own children (zombies included until they are reaped). Kernels
+ * built without CONFIG_PROC_CHILDREN do not have that file, and then every
+ * numeric /proc entry is checked.
+ **/
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "proc_scan.h"
+
+#define DIR_BUF  (1 << 15)
+#define STAT_BUF 512 /* pid, (comm), state and ppid always fit: comm is at most 16 bytes */
+
+struct linux_dirent64 {
+	ino64_t        d_ino;
+	off64_t        d_off;
+	unsigned short d_reclen;
+	unsigned char  d_type;
+	char           d_name[];
+};
+
+static char dir_buf[DIR_BUF];
+static char stat_buf[STAT_BUF];
+static int proc_fd = -1;
+
+/**
+ * Opens /proc once and keeps it. Returns -1 if it is not mounted
+ **/
+static int proc_dir(void)
+{
+	if (proc_fd < 0)
+		proc_fd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	return proc_fd;
+}
+
+/**
+ * Parses a decimal name. Returns 0 for anything that is not a pid
+ **/
+static pid_t parse_pid(const char * name)
+{
+	pid_t pid = 0;
+	if (*name < '1' || *name > '9') return 0;
+	for (; *name; name++)
+	{
+		if (*name < '0' || *name > '9') return 0;
+		pid = pid * 10 + (*name - '0');
+	}
+	return pid;
+}
+
+/**
+ * Writes "<pid>/stat" into buf and returns buf
+ **/
+static char * stat_path(char * buf, pid_t pid)
+{
+	char digits[16];
+	int n = 0;
+	do digits[n++] = '0' + pid % 10; while ((pid /= 10) > 0);
+	char * p = buf;
+	while (n > 0) *p++ = digits[--n];
+	memcpy(p, "/stat", 6);
+	return buf;
+}
+
+/**
+ * Reads state and ppid of a process. The command name may contain blanks
+ * and parentheses, so fields are taken from after the last ')'.
+ * Returns -1 if the process is gone
+ **/
+static int read_stat(pid_t pid, char * state, pid_t * ppid)
+{
+	char path[32];
+	int fd = openat(proc_fd, stat_path(path, pid), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return -1;
+	ssize_t n = pread(fd, stat_buf, STAT_BUF - 1, 0);
+	close(fd);
+	if (n <= 0) return -1;
+	stat_buf[n] = '\0';
+
+	char * p = strrchr(stat_buf, ')');
+	if (p == NULL || p[1] != ' ' || p[2] == '\0' || p[3] != ' ') return -1;
+	*state = p[2];
+	*ppid = 0;
+	for (p += 4; *p >= '0' && *p <= '9'; p++) *ppid = *ppid * 10 + (*p - '0');
+	return 0;
+}
+
+/**
+ * Zombie children of the shell from /proc/self/task/<tid>/children. Every
+ * thread has its own list, so all tasks are read. Returns the number of
+ * pids stored, or SCAN_UNAVAILABLE if the kernel lacks the children file
+ **/
+size_t children_zombies(pid_t * pids, size_t max)
+{
+	if (proc_dir() < 0) return SCAN_UNAVAILABLE;
+	int task_fd = openat(proc_fd, "self/task", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (task_fd < 0) return SCAN_UNAVAILABLE;
+
+	pid_t self = getpid();
+	size_t found = 0, lists = 0;
+	long nread;
+	while ((nread = syscall(SYS_getdents64, task_fd, dir_buf, DIR_BUF)) > 0)
+	{
+		for (long off = 0; off < nread; )
+		{
+			struct linux_dirent64 * d = (struct linux_dirent64 *) (dir_buf + off);
+			off += d->d_reclen;
+			if (parse_pid(d->d_name) == 0) continue;
+
+			char path[300];
+			strcpy(path, d->d_name);
+			strcat(path, "/children");
+			int fd = openat(task_fd, path, O_RDONLY | O_CLOEXEC);
+			if (fd < 0) continue;
+			lists++;
+
+			/* "pid pid pid " read in chunks; a pid may span two reads */
+			char chunk[4096];
+			pid_t pid = 0;
+			ssize_t n;
+			while ((n = read(fd, chunk, sizeof(chunk))) > 0)
+			{
+				for (ssize_t i = 0; i < n; i++)
+				{
+					if (chunk[i] >= '0' && chunk[i] <= '9')
+					{
+						pid = pid * 10 + (chunk[i] - '0');
+						continue;
+					}
+					char state;
+					pid_t ppid;
+					if (pid > 0 && found < max && read_stat(pid, &state, &ppid) == 0 &&
+					    state == 'Z' && ppid == self)
+						pids[found++] = pid;
+					pid = 0;
+				}
+			}
+			close(fd);
+		}
+	}
+	close(task_fd);
+	return lists > 0 ? found : SCAN_UNAVAILABLE;
+}
+
+/**
+ * Zombie children of 'parent' checking every numeric /proc entry.
+ * Returns the number of pids stored
+ **/
+size_t scan_zombies(pid_t parent, pid_t * pids, size_t max)
+{
+	if (proc_dir() < 0) return 0;
+	if (lseek(proc_fd, 0, SEEK_SET) < 0) return 0;
+
+	size_t found = 0;
+	long nread;
+	while ((nread = syscall(SYS_getdents64, proc_fd, dir_buf, DIR_BUF)) > 0)
+	{
+		for (long off = 0; off < nread && found < max; )
+		{
+			struct linux_dirent64 * d = (struct linux_dirent64 *) (dir_buf + off);
+			off += d->d_reclen;
+			pid_t pid = parse_pid(d->d_name);
+			char state;
+			pid_t ppid;
+			if (pid > 0 && read_stat(pid, &state, &ppid) == 0 && state == 'Z' && ppid == parent)
+				pids[found++] = pid;
+		}
+	}
+	return found;
+}
+
+/**
+ * Zombie children of the shell: the children lists when the kernel has
+ * them, the full /proc scan otherwise
+ **/
+size_t find_zombies(pid_t * pids, size_t max)
+{
+	size_t found = children_zombies(pids, max);
+	if (found == SCAN_UNAVAILABLE) found = scan_zombies(getpid(), pids, max);
+	return found;
+}
@@ -0,0 +1,23 @@
+/**
+ * Linux Job Control Shell Project
+ * Function prototypes for proc_scan module
+ *
+ * Finds zombie children of the shell (builtin zjobs) without stdio: the
+ * /proc directory is read with getdents64() and each stat file with
+ * openat() + pread() into one reused buffer.
+ **/
+#ifndef _PROC_SCAN_H
+#define _PROC_SCAN_H
+
+#include <sys/types.h>
+
+#define SCAN_UNAVAILABLE ((size_t) -1)
+
+/**
+ * Public Functions
+ **/
+size_t children_zombies(pid_t * pids, size_t max);
+size_t scan_zombies(pid_t parent, pid_t * pids, size_t max);
+size_t find_zombies(pid_t * pids, size_t max);
+
+#endif
@@ -0,0 +1,270 @@
+/**
+ * Linux Job Control Shell Project
+ * serve module
+ *
+ * Sockets are non-blocking. Input is split into lines in a per-client
+ * buffer; output that the client does not take at once is kept and sent
+ * when epoll reports the socket writable. Client ids grow monotonically,
+ * so an id kept by a job never refers to a later connection.
+ **/
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "event_loop.h"
+#include "serve.h"
+
+#define SERVE_READ 65536
+
+typedef struct client_
+{
+	int id;
+	int fd;
+	unsigned long seq;   /* Lines received */
+	int eof;             /* The client shut down its side: no more lines, replies still sent */
+	int jobs;            /* Its jobs not finished yet (serve_hold/serve_release) */
+	char * in;           /* Bytes of an incomplete line */
+	size_t in_len, in_cap;
+	char * out;          /* Replies not sent yet */
+	size_t out_len, out_cap;
+	struct client_ * next;
+} client;
+
+static int listen_fd = -1;
+static char socket_path[108];
+static serve_line_fn line_handler;
+static client * clients;
+static int last_id;
+
+static client * find_client(int id)
+{
+	for (client * c = clients; c; c = c->next)
+		if (c->id == id) return c;
+	return NULL;
+}
+
+static void drop_client(client * c)
+{
+	client ** p = &clients;
+	while (*p != c) p = &(*p)->next;
+	*p = c->next;
+	ev_del(c->fd);
+	close(c->fd);
+	free(c->in);
+	free(c->out);
+	free(c);
+}
+
+static int grow(char ** buf, size_t * cap, size_t need)
+{
+	if (need <= *cap) return 0;
+	size_t n = *cap ? *cap : 4096;
+	while (n < need) n *= 2;
+	char * aux = realloc(*buf, n);
+	if (aux == NULL) return -1;
+	*buf = aux;
+	*cap = n;
+	return 0;
+}
+
+/* Sends pending output. Returns -1 if the connection is broken */
+static int flush_client(client * c)
+{
+	size_t done = 0;
+	while (done < c->out_len)
+	{
+		ssize_t w = send(c->fd, c->out + done, c->out_len - done, MSG_NOSIGNAL);
+		if (w > 0) done += w;
+		else if (w == -1 && errno == EINTR) continue;
+		else if (w == -1 && errno == EAGAIN) break;
+		else return -1;
+	}
+	memmove(c->out, c->out + done, c->out_len - done);
+	c->out_len -= done;
+	ev_mod(c->fd, (c->eof ? 0 : EPOLLIN) | (c->out_len ? EPOLLOUT : 0));
+	return 0;
+}
+
+/* A client that stopped sending is dropped once its jobs have ended and everything was sent */
+static int finished(client * c)
+{
+	return c->eof && c->jobs == 0 && c->out_len == 0;
+}
+
+/**
+ * Queues data for a client and tries to send it. Returns -1 if the client
+ * is gone (or was disconnected for not reading)
+ **/
+int serve_send(int id, const char * data, size_t n)
+{
+	client * c = find_client(id);
+	if (c == NULL) return -1;
+	if (c->out_len + n > SERVE_OUTPUT_MAX || grow(&c->out, &c->out_cap, c->out_len + n) == -1)
+	{
+		drop_client(c);
+		return -1;
+	}
+	memcpy(c->out + c->out_len, data, n);
+	c->out_len += n;
+	if (flush_client(c) == -1)
+	{
+		drop_client(c);
+		return -1;
+	}
+	return 0;
+}
+
+static void on_client(int fd, uint32_t events, void * data)
+{
+	client * c = data;
+	int id = c->id;
+
+	if ((events & EPOLLOUT) && flush_client(c) == -1)
+	{
+		drop_client(c);
+		return;
+	}
+	if (c->eof)
+	{
+		/* EPOLLHUP: both directions closed, nobody will read the replies */
+		if ((events & (EPOLLHUP | EPOLLERR)) || finished(c)) drop_client(c);
+		return;
+	}
+	if (!(events & (EPOLLIN | EPOLLHUP | EPOLLERR))) return;
+
+	while (1)
+	{
+		if (grow(&c->in, &c->in_cap, c->in_len + SERVE_READ) == -1)
+		{
+			drop_client(c);
+			return;
+		}
+		ssize_t n = read(fd, c->in + c->in_len, SERVE_READ);
+		if (n == -1 && errno == EINTR) continue;
+		if (n == -1 && errno == EAGAIN) break;
+		if (n == 0)
+		{
+			/* A last command without its '\n' still runs, as read_line() does at EOF.
+			 * grow() left room for the '\n' */
+			if (c->in_len > 0)
+			{
+				c->in[c->in_len++] = '\n';
+				line_handler(id, ++c->seq, c->in, c->in_len);
+				if ((c = find_client(id)) == NULL) return;
+				c->in_len = 0;
+			}
+			/* Half-closed (shutdown(SHUT_WR)): the client still reads its jobs' events */
+			c->eof = 1;
+			if (finished(c) || flush_client(c) == -1) drop_client(c);
+			return;
+		}
+		if (n < 0)
+		{
+			drop_client(c); /* Its jobs keep running; their events have nowhere to go */
+			return;
+		}
+		size_t scanned = c->in_len, start = 0;
+		c->in_len += n;
+
+		/* Every complete line; the handler may drop the client while sending a reply */
+		char * nl;
+		while ((nl = memchr(c->in + scanned, '\n', c->in_len - scanned)) != NULL)
+		{
+			size_t end = nl - c->in + 1;
+			line_handler(id, ++c->seq, c->in + start, end - start);
+			if ((c = find_client(id)) == NULL) return;
+			start = scanned = end;
+		}
+		memmove(c->in, c->in + start, c->in_len - start);
+		c->in_len -= start;
+	}
+}
+
+static void on_accept(int fd, uint32_t events, void * data)
+{
+	int cfd;
+	while ((cfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+	{
+		client * c = calloc(1, sizeof(client));
+		if (c == NULL || ev_add(cfd, EPOLLIN, on_client, c) == -1)
+		{
+			free(c);
+			close(cfd);
+			continue;
+		}
+		c->id = ++last_id;
+		c->fd = cfd;
+		c->next = clients;
+		clients = c;
+	}
+}
+
+/**
+ * A job of client id started / ended. A client that has shut down its
+ * side is kept until its last job has ended
+ **/
+void serve_hold(int id)
+{
+	client * c = find_client(id);
+	if (c != NULL) c->jobs++;
+}
+
+void serve_release(int id)
+{
+	client * c = find_client(id);
+	if (c != NULL && c->jobs > 0 && --c->jobs == 0 && finished(c)) drop_client(c);
+}
+
+/* Returns 1 if path is a socket nobody listens on any more */
+static int stale_socket(const char * path, const struct sockaddr_un * addr)
+{
+	struct stat st;
+	if (lstat(path, &st) == -1 || !S_ISSOCK(st.st_mode)) return 0;
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd == -1) return 0;
+	int r = connect(fd, (const struct sockaddr *) addr, sizeof(*addr));
+	close(fd);
+	return r == -1 && errno == ECONNREFUSED;
+}
+
+/**
+ * Listens on a Unix socket at path (replacing a stale socket, never any
+ * other file) and calls on_line for each command line received. Returns
+ * -1 on error
+ **/
+int serve_open(const char * path, serve_line_fn on_line)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	if (strlen(path) >= sizeof(addr.sun_path))
+	{
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+	listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (listen_fd == -1) return -1;
+	if (stale_socket(path, &addr)) unlink(path);
+	if (bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) == -1 || listen(listen_fd, SOMAXCONN) == -1 ||
+	    ev_add(listen_fd, EPOLLIN, on_accept, NULL) == -1)
+	{
+		close(listen_fd);
+		listen_fd = -1;
+		return -1;
+	}
+	strcpy(socket_path, path);
+	line_handler = on_line;
+	return 0;
+}
+
+/**
+ * Removes the socket file (atexit)
+ **/
+void serve_close(void)
+{
+	if (listen_fd >= 0) unlink(socket_path);
+}
@@ -0,0 +1,34 @@
+/**
+ * Linux Job Control Shell Project
+ * Function prototypes for serve module
+ *
+ * Daemon mode (--serve PATH): clients connect to a Unix stream socket and
+ * write command lines, as many per write as they like. Every complete line
+ * is handed to the shell, which starts it as a background job and answers
+ * on the same connection with JSON lines (status_stream.h): first
+ * {"event":"submitted","seq":N,...} or {"event":"error","seq":N,...},
+ * where seq numbers the client's lines from 1, then the job's events.
+ * A client may shut down its writing side after the last line, which then
+ * needs no '\n': it still gets the events until all its jobs have ended.
+ * All connections are served from the shell's epoll loop.
+ **/
+#ifndef _SERVE_H
+#define _SERVE_H
+
+#include <stddef.h>
+
+#define SERVE_OUTPUT_MAX (4 << 20) /* Unsent bytes a client may pile up before it is disconnected */
+
+/* Called for each line (including its '\n'); client identifies the connection */
+typedef void (*serve_line_fn)(int client, unsigned long seq, char * line, int length);
+
+/**
+ * Public Functions
+ **/
+int serve_open(const char * path, serve_line_fn on_line);
+int serve_send(int client, const char * data, size_t n);
+void serve_hold(int client);
+void serve_release(int client);
+void serve_close(void);
+
+#endif
@@ -9,97 +9,1189 @@
  *
  * Some code adapted from "OS Concepts Essentials", Silberschatz et al.
  *
- * To compile and run the program:
- *   $ gcc shell.c job_control.c -o shell
+ * To compile and run the program (or just: make):
+ *   $ gcc shell.c job_control.c event_loop.c launch.c pipe_stage.c mem_pool.c proc_scan.c file_count.c trace.c stats.c event_log.c status_stream.c serve.c zygote.c watchdog.c capture.c -pthread -o shell
  *   $ ./shell
  *	(then type ^D to exit program)
+ *
+ * Non-interactive use (no prompt, no terminal control):
+ *   $ ./shell -c "command"      or      $ ./shell < script
+ *
+ * JSON-lines job events (status_stream.h) for supervisors:
+ *   $ ./shell --status-fd 3 3>events.jsonl      or      --status-socket PATH
+ *
+ * Daemon mode, commands submitted over a Unix socket (serve.h):
+ *   $ ./shell --serve /tmp/shell.sock
  **/
 
+#define _GNU_SOURCE
 #include "job_control.h"   /* Remember to compile with module job_control.c */
+#include "event_loop.h"    /* and with modules event_loop.c */
+#include "launch.h"        /* launch.c */
+#include "pipe_stage.h"    /* pipe_stage.c */
+#include "mem_pool.h"      /* mem_pool.c */
+#include "proc_scan.h"     /* proc_scan.c */
+#include "file_count.h"    /* file_count.c (-pthread) */
+#include "trace.h"         /* trace.c */
+#include "stats.h"         /* stats.c */
+#include "event_log.h"     /* event_log.c */
+#include "status_stream.h" /* status_stream.c */
+#include "serve.h"         /* serve.c */
+#include "zygote.h"        /* zygote.c */
+#include "watchdog.h"      /* watchdog.c */
+#include "capture.h"       /* and capture.c */
 
-#define MAX_LINE 256 /* 256 chars per line, per command, should be enough */
 
 job* job_list;
 
+sigset_t shell_signals; /* SIGCHLD y SIGHUP: bloqueadas siempre, se leen del signalfd */
+sigset_t child_sigmask; /* Máscara original, la que heredan los comandos */
+int stdin_ready;        /* El bucle de eventos ha visto stdin listo para leer */
+int stdin_pollable = 1; /* 0 si stdin es un fichero regular (epoll no lo admite) */
+int splice_stages = 0;  /* set splice on: cat y tee de una tubería los ejecuta el propio shell */
+int interactive;        /* stdin es un terminal y no hay -c: prompt y control del terminal */
+line_reader input;      /* Líneas de comandos, de stdin o de -c */
+arena command_arena;    /* Memoria de una línea de comandos: se libera entera en cada vuelta */
+unsigned long last_command_allocs; /* mallocs durante la última línea (memstat) */
+int log_jobs = 0;       /* log jobs on: los cambios de estado de los trabajos también van al log */
+int stats_fd = -1;      /* stats file: se vuelcan las estadísticas al salir y con SIGHUP */
+int sig_fd = -1;        /* signalfd de shell_signals (y de SIGINT mientras wait espera) */
+job *launch_into;       /* Trabajo en espera (after) que register_job() pone en marcha en vez de crear uno */
+int bg_policy = -1;     /* set bgsched batch|idle: política de los trabajos en segundo plano sin sched, -1 ninguna */
+
+void team_job_done(int id);
+void finish_job(job* the_job, int ok);
+
 /* ----------------- AMPLIACION ----------------- */
 
-#include <dirent.h>
 #include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/signalfd.h>
 
+/* Zombis hijos del shell: listas children del kernel o recorrido de /proc (proc_scan.c) */
 void traverse_proc(void) {
-    DIR *d; 
-    struct dirent *dir;
-    char buff[2048];
-    d = opendir("/proc");
-    if (d) {
-        while ((dir = readdir(d)) != NULL) {
-            sprintf(buff, "/proc/%s/stat", dir->d_name); 
-            FILE *fd = fopen(buff, "r");
-            if (fd){
-                long pid;     // pid
-                long ppid;    // ppid
-                char state;   // estado: R (runnable), S (sleeping), T(stopped), Z (zombie)
-
-                // La siguiente línea lee pid, state y ppid de /proc/<pid>/stat
-                fscanf(fd, "%ld %s %c %ld", &pid, buff, &state, &ppid);
-				if (ppid == getpid() && state == 'Z') {
-					printf("%ld\n", pid);
-				}
-                fclose(fd);
-            }
-        }
-        closedir(d);
-    }
+	static pid_t zombies[4096];
+	size_t n = find_zombies(zombies, sizeof(zombies) / sizeof(zombies[0]));
+	for (size_t i = 0; i < n; i++) {
+		printf("%ld\n", (long) zombies[i]);
+	}
 }
 
 /* ---------------------------------------------- */
 
-void sigchld_handler() {
-	block_SIGCHLD();
+/* Coste del reaper, para vigilarlo bajo una avalancha de SIGCHLD (builtin reapstat) */
+struct {
+	unsigned long events;    // Invocaciones del manejador
+	unsigned long waits;     // Llamadas a waitpid
+	unsigned long reaped;    // Cambios de estado recogidos
+	unsigned long stray;     // Pids que no pertenecen a ningún trabajo
+	unsigned long max_batch; // Máximo de cambios recogidos en una invocación
+	long long ns;            // Tiempo total dentro del reaper
+} reap_stats;
+
+/* Evento de un trabajo para el stream JSON y, si lo envió un cliente de --serve, para ese cliente */
+void notify_job(const char *event, job* the_job, const char *old_state, const char *new_state, const char *status, int info) {
+	status_event(event, the_job, old_state, new_state, status, info);
+	if (the_job->client) {
+		size_t n;
+		const char *line = status_format(event, the_job, old_state, new_state, status, info, &n);
+		if (line == NULL || serve_send(the_job->client, line, n) == -1) the_job->client = 0; // Cliente desconectado
+	}
+}
 
-	job* iter = get_iterator(job_list);
-    pid_t pid_wait;
-    enum status status_res;
-    int status, info;
+/* Saca un trabajo de la lista y deja de vigilar su pidfd y su plazo */
+void drop_job(job* the_job) {
+	watchdog_cancel(the_job);
+	if (the_job->pidfd >= 0) {
+		ev_del(the_job->pidfd);
+		close(the_job->pidfd);
+	}
+	if (the_job->client) serve_release(the_job->client); // Tras su último evento
+	delete_job(job_list, the_job);
+}
 
-	while(has_next(iter)){
-		job* the_job = next(iter);
-		pid_wait = waitpid(-the_job->pgid, &status, WCONTINUED | WNOHANG | WUNTRACED);  // ¿Signo - para the_job->pgid?
+/* Límite que ha matado a un trabajo, para la línea del reaper. SIGXCPU (o el SIGKILL del límite duro
+ * con la CPU ya gastada) lo señala el kernel; con as, nofile o nproc el programa solo ve fallar
+ * malloc, open o fork, así que se indica como posible si acaba mal */
+const char *limit_cause(job *the_job, enum status status_res, int info, char *buf, size_t size) {
+	launch_limits *l = &the_job->limits;
+	char value[32];
+	size_t n = 0;
+	buf[0] = '\0';
+	if (!l->set || (status_res != SIGNALED && status_res != EXITED)) return buf;
+	if ((l->set & (1u << LIMIT_CPU)) && status_res == SIGNALED) {
+		rlim_t cpu = the_job->usage.ru_utime.tv_sec + the_job->usage.ru_stime.tv_sec;
+		if (info == SIGXCPU || (info == SIGKILL && cpu >= l->value[LIMIT_CPU])) {
+			format_limit(LIMIT_CPU, l->value[LIMIT_CPU], value, sizeof(value));
+			snprintf(buf, size, " (cpu limit %s)", value);
+			return buf;
+		}
+	}
+	if (status_res == SIGNALED ? info != SIGSEGV && info != SIGABRT && info != SIGBUS : info == 0) return buf;
+	for (int i = 0; i < LIMITS && n < size; i++) {
+		if (i == LIMIT_CPU || !(l->set & (1u << i)) || l->value[i] == RLIM_INFINITY) continue;
+		format_limit(i, l->value[i], value, sizeof(value));
+		n += snprintf(buf + n, size - n, "%s%s limit %s", n ? ", " : " (possibly ", limit_names[i], value);
+	}
+	if (n && n < size) snprintf(buf + n, size - n, ")");
+	return buf;
+}
 
-		if (pid_wait == the_job->pgid){
-			status_res = analyze_status(status, &info);
+/* Vacía wait4(-1) hasta que no queden cambios y localiza cada trabajo por su pid.
+ * El rusage de cada proceso terminado se suma al de su trabajo.
+ * noticed: cuando epoll_wait devolvió el SIGCHLD o el pidfd que nos despierta */
+void reap_children(uint64_t noticed) {
+	struct timespec t0, t1;
+	pid_t pid_wait;
+	enum status status_res;
+	int status, info;
+	struct rusage usage;
+	unsigned long batch = 0;
+	int saved_errno = errno;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	reap_stats.events++;
+
+	while (1) {
+		pid_wait = wait4(-1, &status, WNOHANG | WUNTRACED | WCONTINUED, &usage);
+		reap_stats.waits++;
+		if (pid_wait > 0) {
+			trace_event(TRACE_WAIT, pid_wait, status);
+			hist_record(&stats.reap, stats_now() - noticed);
+		}
+		if (pid_wait == 0) break; // Quedan hijos pero ninguno ha cambiado de estado
+		if (pid_wait == -1) {
+			if (errno == EINTR) continue;
+			if (errno != ECHILD) perror("Wait error");
+			break;
+		}
+		batch++;
 
-			// Informamos del cambio de estado de la tarea
-            printf("\nBackground pid: %d, command: %s, %s, info: %d\n", the_job->pgid, the_job->command, status_strings[status_res], info);
+		job* the_job = get_item_byproc(job_list, pid_wait);
+		if (the_job == NULL) {
+			reap_stats.stray++;
+			continue;
+		}
+		status_res = analyze_status(status, &info);
+		enum job_state old_state = the_job->state;
 
-			if (status_res == SUSPENDED){ // Si la tarea ha sido suspendida
-				the_job->state = STOPPED;
+		if (status_res == SUSPENDED){ // Si la tarea ha sido suspendida
+			if (old_state == STOPPED) continue; // Otra etapa de la misma tubería
+			the_job->state = STOPPED;
+			stats.suspended++;
+		}
+		else if (status_res == CONTINUED){ // Si la tarea estaba suspendida y se ha reanudado
+			if (old_state == FOREGROUND || pid_wait != the_job->pgid) continue; // fg ya la ha reanudado, u otra etapa de la tubería
+			the_job->state = BACKGROUND;
+			stats.continued++;
+		}
+		else {
+			if (pid_wait == the_job->last_pid) the_job->exit_status = status;
+			add_usage(the_job, &usage);
+			if (delete_process(job_list, pid_wait) > 0) {
+				if (pid_wait == the_job->pgid && the_job->pidfd >= 0) {
+					// El pidfd del líder ya recogido seguiría siempre listo: el resto llega por SIGCHLD
+					ev_del(the_job->pidfd);
+					close(the_job->pidfd);
+					the_job->pidfd = -1;
+				}
+				continue; // Aún quedan procesos vivos en el trabajo
 			}
-			else if (status_res == CONTINUED){ // Si la tarea estaba suspendida y se ha reanudado
-				the_job->state = BACKGROUND;
+			status_res = analyze_status(the_job->exit_status, &info); // El de la última etapa
+		}
+
+		// Informamos del cambio de estado de la tarea
+		trace_event(TRACE_STATE, the_job->pgid, status_res == SIGNALED || status_res == EXITED ? -1 : (int) the_job->state);
+		if (log_jobs) log_event(LOG_JOB, the_job->pgid, status_res, info, the_job->command);
+		notify_job("state", the_job, state_strings[old_state],
+			status_res == SIGNALED || status_res == EXITED ? "Done" : state_strings[the_job->state],
+			status_strings[status_res], info);
+		char cause[96];
+		printf("\n%s pid: %d, command: %s, %s, info: %d%s%s\n", old_state == FOREGROUND ? "Foreground" : "Background",
+			the_job->pgid, the_job->command, status_strings[status_res], info,
+			the_job->timed_out && (status_res == SIGNALED || status_res == EXITED) ? " (timeout)" : "",
+			limit_cause(the_job, status_res, info, cause, sizeof(cause)));
+
+		if (status_res == SIGNALED || status_res == EXITED){ // La tarea ha terminado, luego la borramos
+			if (the_job->timed) print_usage(the_job);
+			stats.reaped++;
+			if (old_state == FOREGROUND) {
+				hist_record(&stats.foreground, (the_job->end.tv_sec - the_job->start.tv_sec) * 1000000000ULL
+					+ the_job->end.tv_nsec - the_job->start.tv_nsec);
 			}
-			else { // Si no, la tarea ha terminado, luego la borramos
-				delete_job(job_list, the_job);
+			int team = the_job->team;
+			finish_job(the_job, status_res == EXITED && info == 0); // Lanza los sucesores que ya pueden arrancar
+			if (team) team_job_done(team); // Hueco libre: arranca el siguiente de la cola
+		}
+	}
+
+	status_flush(); // Una sola escritura por pasada del reaper
+	reap_stats.reaped += batch;
+	if (batch > reap_stats.max_batch) reap_stats.max_batch = batch;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	reap_stats.ns += (t1.tv_sec - t0.tv_sec) * 1000000000LL + (t1.tv_nsec - t0.tv_nsec);
+	errno = saved_errno;
+}
+
+void on_pidfd(int fd, uint32_t events, void *data) {
+	reap_children(ev_woken()); // Ha terminado un trabajo: el reaper recoge todo lo pendiente
+}
+
+void on_stdin(int fd, uint32_t events, void *data) {
+	stdin_ready = 1;
+}
+
+/* Alta de un trabajo en la lista, vigilando su pidfd desde el bucle de eventos.
+ * Un sucesor de after ya estaba en la lista en espera: conserva su número */
+job* register_job(pid_t pgid, const char *command, enum job_state state) {
+	job* the_job = launch_into;
+	if (the_job != NULL) {
+		launch_into = NULL;
+		if (!set_job_pgid(job_list, the_job, pgid)) return NULL;
+		the_job->state = state;
+		clock_gettime(CLOCK_MONOTONIC, &the_job->start);
+		the_job->end = the_job->start;
+		trace_event(TRACE_STATE, pgid, state);
+		notify_job("state", the_job, state_strings[WAITING], state_strings[state], NULL, 0);
+	}
+	else {
+		the_job = new_job(pgid, command, state);
+		if (the_job == NULL || !add_job(job_list, the_job)) {
+			// Fuera de la lista nadie lo vigilaría: se mata el grupo y el reaper lo recoge como huérfano
+			perror("Job list");
+			if (the_job != NULL) free_job(the_job);
+			killpg(pgid, SIGKILL);
+			return NULL;
+		}
+		notify_job("start", the_job, NULL, state_strings[state], NULL, 0);
+	}
+	stats.started++;
+	the_job->pidfd = pidfd_open_job(pgid);
+	if (the_job->pidfd >= 0 && ev_add(the_job->pidfd, EPOLLIN, on_pidfd, NULL) == -1) {
+		close(the_job->pidfd);
+		the_job->pidfd = -1;
+	}
+	return the_job;
+}
+
+/* Lanza un comando externo (fork o vfork según launch_mode) e informa si falla antes del exec.
+ * La ruta sale de la caché de PATH; si ya no existe, se olvida y se busca de nuevo una vez */
+pid_t start_command(launch_spec *spec) {
+	int cached = (spec->file == NULL);
+	spec->sigmask = &child_sigmask;
+	fflush(stdout); // Que lo ya escrito por el shell salga antes que la salida del hijo
+	uint64_t t0 = stats_now();
+	if (cached) spec->file = path_lookup(spec->argv[0]);
+	pid_t pid = launch_command(spec);
+	if (pid > 0 && cached && spec->file && spec->err == ENOENT && !strcmp(spec->failed, "exec")) {
+		path_forget(spec->argv[0]); // El hijo fallido lo recoge el reaper como huérfano
+		spec->file = path_lookup(spec->argv[0]);
+		pid = launch_command(spec);
+	}
+	if (cached) spec->file = NULL; // Se vuelve a consultar en cada lanzamiento (bgteam)
+	if (pid > 0 && !spec->err) hist_record(&stats.spawn, stats_now() - t0); // El padre sigue cuando el hijo ya ha hecho exec
+	if (pid == -1) {
+		perror("Fork error");
+	}
+	else if (spec->err) {
+		trace_event(TRACE_EXEC_FAIL, pid, spec->err);
+		if (!strcmp(spec->failed, "exec")) {
+			printf("\nError, command not found: %s\n", spec->argv[0]);
+		}
+		else {
+			fprintf(stderr, "%s error: %s\n", !strcmp(spec->failed, "placement") ? "Placement" :
+				!strcmp(spec->failed, "limits") ? "Limit" : "Redirection", strerror(spec->err));
+		}
+	}
+	return pid;
+}
+
+/* Lanza una tubería de n etapas en un único grupo de procesos y la registra como un solo trabajo.
+ * Las etapas se enlazan con pipes close-on-exec: cada hijo solo conserva sus copias dup2'adas */
+job* start_pipeline(launch_spec specs[], int n, enum job_state state, const char *command) {
+	job* the_job = NULL;
+	pid_t pgid = 0;
+	int fds[2];
+
+	for (int i = 0; i < n; i++) {
+		if (i < n - 1) {
+			if (pipe2(fds, O_CLOEXEC) == -1) {
+				perror("Pipe error");
+				if (specs[i].fd_in > 0) close(specs[i].fd_in);
+				break;
 			}
+			specs[i].fd_out = fds[1];
+			specs[i+1].fd_in = fds[0];
+		}
+		specs[i].pgid = pgid;
+		specs[i].sigmask = &child_sigmask; // También para las etapas nativas, que no pasan por start_command()
+
+		pid_t pid;
+		if (!strcmp(specs[i].argv[0], "fico")) {
+			fflush(stdout);
+			pid = launch_function(&specs[i], file_count_run);
+			if (pid == -1) perror("Fork error");
+		}
+		else if (splice_stages && pipe_stage_native(specs[i].argv)) {
+			fflush(stdout);
+			pid = launch_function(&specs[i], pipe_stage_run);
+			if (pid == -1) perror("Fork error");
 		}
-		else if (pid_wait == -1){
+		else {
+			pid = start_command(&specs[i]);
+		}
+
+		// El padre no usa los extremos de esta etapa (el pipe de la captura lo cierra quien lo creó)
+		if (specs[i].fd_in > 0) close(specs[i].fd_in);
+		if (specs[i].fd_out > 0 && specs[i].fd_out != specs[i].fd_err) close(specs[i].fd_out);
+
+		if (pid == -1) {
+			if (i < n - 1) close(specs[i+1].fd_in);
+			break;
+		}
+		trace_event(TRACE_SPAWN, pid, i);
+		if (pgid == 0) {
+			pgid = pid;
+			new_process_group(pid);
+			the_job = register_job(pid, command, state);
+			if (the_job == NULL) {
+				if (i < n - 1) close(specs[i+1].fd_in);
+				break;
+			}
+		}
+		else {
+			setpgid(pid, pgid);
+			add_process(job_list, the_job, pid);
+		}
+		the_job->last_pid = pid;
+	}
+	return the_job;
+}
+
+/* Cede el terminal al trabajo y atiende eventos hasta que termina o se suspende */
+void wait_foreground(job* the_job) {
+	pid_t pgid = the_job->pgid;
+	if (interactive) {
+		set_terminal(pgid);
+		trace_event(TRACE_TERMINAL, pgid, 0);
+	}
+	if (stdin_pollable) ev_mod(STDIN_FILENO, 0); // La entrada es del trabajo, no del shell
+	while ((the_job = get_item_bypid(job_list, pgid)) != NULL && the_job->state == FOREGROUND) {
+		if (ev_run_once(-1) == -1) {
 			perror("Wait error");
+			break;
+		}
+	}
+	if (stdin_pollable) ev_mod(STDIN_FILENO, EPOLLIN);
+	if (interactive) {
+		set_terminal(getpid());
+		trace_event(TRACE_TERMINAL, getpid(), 0);
+	}
+}
+
+/* Políticas de sched y set bgsched */
+static const struct { const char *name; int policy; } policy_names[] = {
+	{ "other", SCHED_OTHER }, { "batch", SCHED_BATCH }, { "idle", SCHED_IDLE }, { "fifo", SCHED_FIFO }, { "rr", SCHED_RR }
+};
+
+int parse_policy(const char *name) {
+	for (size_t i = 0; i < 3; i++) // Las de tiempo real no se ofrecen
+		if (!strcmp(name, policy_names[i].name)) return policy_names[i].policy;
+	return -1;
+}
+
+const char *policy_name(int policy) {
+	for (size_t i = 0; i < sizeof(policy_names) / sizeof(policy_names[0]); i++)
+		if (policy_names[i].policy == policy) return policy_names[i].name;
+	return "?";
+}
+
+/* Ubicación de un trabajo: la pedida con taskset/nice/sched y, en segundo plano, la política de set bgsched */
+const launch_place *effective_place(const launch_place *place, int background, launch_place *buf) {
+	if (!background || bg_policy == -1 || (place != NULL && place->has_policy)) return place;
+	*buf = place ? *place : (launch_place) { .has_cpus = 0 };
+	buf->policy = bg_policy;
+	buf->has_policy = 1;
+	return buf;
+}
+
+/* Prefijos taskset [-c] CPUS, nice [-n N] y sched other|batch|idle: se quitan de args y se anotan en place.
+ * Devuelve -1 si alguno está mal */
+int parse_place(char ***args, launch_place *place) {
+	char **a = *args;
+	while (*a != NULL) {
+		if (!strcmp(*a, "taskset")) {
+			if (a[1] != NULL && !strcmp(a[1], "-c")) a++;
+			if (a[1] == NULL || parse_cpu_list(a[1], &place->cpus) == -1) return -1;
+			place->has_cpus = 1;
+			a += 2;
+		}
+		else if (!strcmp(*a, "nice")) {
+			place->nice = 10; // Como nice(1)
+			if (a[1] != NULL && !strcmp(a[1], "-n")) {
+				char *end;
+				if (a[2] == NULL || (place->nice = strtol(a[2], &end, 10), *end != '\0' || end == a[2])) return -1;
+				a += 2;
+			}
+			place->has_nice = 1;
+			a++;
 		}
+		else if (!strcmp(*a, "sched")) {
+			if (a[1] == NULL || (place->policy = parse_policy(a[1])) == -1) return -1;
+			place->has_policy = 1;
+			a += 2;
+		}
+		else break;
 	}
+	if (*a == NULL) return -1;
+	*args = a;
+	return 0;
+}
 
-	unblock_SIGCHLD();
+/* Quita de args el prefijo "limit nombre=valor..." (as, cpu, nofile, nproc). -1 si está mal */
+int parse_limits(char ***args, launch_limits *limits) {
+	char **a = *args + 1;
+	for (; *a != NULL && strchr(*a, '=') != NULL; a++)
+		if (parse_limit(*a, limits) == -1) return -1;
+	if (a == *args + 1 || *a == NULL) return -1;
+	*args = a;
+	return 0;
+}
+
+/* Límites blandos y duros de pid (0 para el propio shell, que los hereda a lo que lanza) */
+void print_limits(pid_t pid) {
+	char soft[32], hard[32];
+	for (int i = 0; i < LIMITS; i++) {
+		struct rlimit rl;
+		if (prlimit(pid, limit_resources[i], NULL, &rl) == -1) {
+			perror("limit");
+			return;
+		}
+		format_limit(i, rl.rlim_cur, soft, sizeof(soft));
+		format_limit(i, rl.rlim_max, hard, sizeof(hard));
+		printf("%-8s %s (hard %s)\n", limit_names[i], soft, hard);
+	}
+}
 
+/* limit: los del shell; limit N: los del líder del trabajo N; limit N nombre=valor...: prlimit sobre
+ * todos sus procesos vivos. Un trabajo en espera (after) solo los guarda y se le aplican al lanzarlo */
+void limit_command(char **args) {
+	if (args[1] == NULL) {
+		print_limits(0);
+		return;
+	}
+	job *the_job = get_item_bypos(job_list, atoi(args[1]));
+	if (the_job == NULL) {
+		printf("limit: no such job: %s\n", args[1]);
+		return;
+	}
+	launch_limits limits = { .set = 0 };
+	for (char **a = args + 2; *a != NULL; a++) {
+		if (parse_limit(*a, &limits) == -1) {
+			printf("Usage: limit [job [as=SIZE[K|M|G|T]] [cpu=SECONDS] [nofile=N] [nproc=N]]\n");
+			return;
+		}
+	}
+	if (limits.set == 0) {
+		if (the_job->nprocs > 0) print_limits(the_job->pgid);
+		for (int i = 0; the_job->nprocs == 0 && i < LIMITS; i++) { // En espera: lo que se le aplicará
+			char value[32] = "inherited";
+			if (the_job->limits.set & (1u << i)) format_limit(i, the_job->limits.value[i], value, sizeof(value));
+			printf("%-8s %s\n", limit_names[i], value);
+		}
+		return;
+	}
+	for (proc *p = the_job->procs; p != NULL; p = p->next) {
+		if (apply_limits(p->pid, &limits) == -1 && errno != ESRCH) { // ESRCH: acaba de terminar
+			fprintf(stderr, "limit: pid %d: %s\n", p->pid, strerror(errno));
+			return;
+		}
+	}
+	for (int i = 0; i < LIMITS; i++) {
+		if (!(limits.set & (1u << i))) continue;
+		the_job->limits.value[i] = limits.value[i];
+		the_job->limits.set |= 1u << i;
+	}
+}
+
+/* jobs -v: además del consumo y el plazo, la ubicación efectiva del líder según el kernel */
+void print_item_placed(job *item) {
+	cpu_set_t cpus;
+	char list[256];
+	print_item_verbose(item);
+	if (item->pgid <= 0 || item->nprocs == 0) return;
+	int policy = sched_getscheduler(item->pgid);
+	errno = 0;
+	int nice = getpriority(PRIO_PROCESS, item->pgid);
+	if (policy == -1 || errno || sched_getaffinity(item->pgid, sizeof(cpus), &cpus) == -1) return; // El líder ya ha terminado
+	format_cpu_list(&cpus, list, sizeof(list));
+	printf("     cpus %s, nice %d, sched %s\n", list, nice, policy_name(policy & ~SCHED_RESET_ON_FORK));
+	if (item->limits.set) {
+		printf("     limits");
+		for (int i = 0; i < LIMITS; i++) {
+			if (!(item->limits.set & (1u << i))) continue;
+			format_limit(i, item->limits.value[i], list, sizeof(list));
+			printf(" %s=%s", limit_names[i], list);
+		}
+		printf("\n");
+	}
+}
+
+/* Lanza una línea ya tokenizada (args apunta dentro de cmd->argv) como un único trabajo.
+ * Los specs y el nombre del trabajo salen del arena de la línea; place y limits (o NULL) se aplican a todas las etapas */
+job* launch_line(char **args, command_line *cmd, int background, const launch_place *place, const launch_limits *limits) {
+	launch_place bg_place;
+	place = effective_place(place, background, &bg_place);
+	/* Etapas de la tubería: el tokenizador ya ha separado los '|' y las redirecciones */
+	int nstages = 1;
+	size_t command_len = 1;
+	for (char **a = args; *a != NULL; a++) {
+		if (*a == pipe_token) nstages++;
+		command_len += strlen(*a) + 3;
+	}
+	launch_spec *specs = arena_alloc(cmd->mem, nstages * sizeof(launch_spec));
+	char *command = arena_alloc(cmd->mem, command_len);
+	if (specs == NULL || command == NULL) {
+		perror("Pipeline error");
+		return NULL;
+	}
+	nstages = 0;
+	char **stage = args;
+	command[0] = '\0';
+	for (char **a = args; ; a++) {
+		if (*a != NULL && *a != pipe_token) continue;
+		int last = (*a == NULL);
+		*a = NULL;
+		specs[nstages] = (launch_spec) { .argv = stage, .foreground = !background && interactive, .place = place,
+			.limits = limits };
+
+		/* ----------------- AMPLIACION ----------------- */
+
+		// fico lo cuenta el propio shell (file_count.c) en el hijo, sin lanzar cuentafich.sh
+
+		/* ---------------------------------------------- */
+
+		if (nstages > 0) strcat(command, " | ");
+		strcat(command, stage[0]);
+		nstages++;
+		if (last) break;
+		stage = a + 1;
+	}
+
+	/* Redirecciones de cada etapa; si se repite un tipo vale la última, como en parse_redirections() */
+	for (int r = 0; r < cmd->nredirs; r++) {
+		redirection *rd = &cmd->redirs[r];
+		if (rd->type == '<') specs[rd->stage].file_in = rd->file;
+		if (rd->type == '>') specs[rd->stage].file_out = rd->file;
+
+		/* ----------------- AMPLIACION ----------------- */
+
+		if (rd->type == 'a') specs[rd->stage].file_ap = rd->file;
+
+		/* ---------------------------------------------- */
+	}
+
+	// set capture on: stderr de todas las etapas y stdout de la última van al pipe de la captura
+	int capture_fd = 0;
+	struct capture_ *capture = background ? capture_new(&capture_fd) : NULL;
+	for (int i = 0; capture != NULL && i < nstages; i++) {
+		specs[i].fd_err = capture_fd;
+		if (i == nstages - 1) specs[i].fd_out = capture_fd;
+	}
+
+	job *the_job = start_pipeline(specs, nstages, background ? BACKGROUND : FOREGROUND, command);
+	if (the_job != NULL && limits != NULL) the_job->limits = *limits; // Para explicar su muerte y para limit N
+	if (capture != NULL) {
+		close(capture_fd);
+		if (the_job != NULL) capture_bind(capture, the_job->pos, the_job->pgid, command);
+		else capture_cancel(capture);
+	}
+	return the_job;
+}
+
+/* Línea recibida en modo --serve: siempre un trabajo en segundo plano (sin terminal ni builtins).
+ * Se responde al cliente con el número de trabajo y luego le llegan sus eventos */
+void serve_line(int client, unsigned long seq, char *line, int length) {
+	static arena serve_arena;
+	static command_line cmd = { .mem = &serve_arena };
+	char reply[160];
+	const char *error = NULL;
+	job *the_job = NULL;
+
+	arena_reset(&serve_arena);
+	if (tokenize_line(line, length, &cmd) == -1) error = "syntax error";
+	else if (cmd.argv[0] == NULL) error = "empty command";
+	else if ((the_job = launch_line(cmd.argv, &cmd, 1, NULL, NULL)) == NULL) error = "launch failed";
+
+	int n;
+	if (error) {
+		n = snprintf(reply, sizeof(reply), "{\"event\":\"error\",\"seq\":%lu,\"error\":\"%s\"}\n", seq, error);
+	}
+	else {
+		the_job->client = client;
+		n = snprintf(reply, sizeof(reply), "{\"event\":\"submitted\",\"seq\":%lu,\"job\":%d,\"pgid\":%d}\n",
+			seq, the_job->pos, the_job->pgid);
+	}
+	if (serve_send(client, reply, n) == -1 && the_job) the_job->client = 0;
+	if (the_job && the_job->client) serve_hold(client); // Aunque cierre su lado, recibe los eventos hasta que acabe
 }
 
 /* ----------------- AMPLIACION ----------------- */
 
-void sighup_handler() {
-	FILE *fp;
-	fp=fopen("hup.txt","a"); // abre un fichero en modo 'append'
-	if (fp) { 
-		fprintf(fp, "SIGHUP recibido.\n"); //escribe en el fichero
-		fclose(fp);
+/* Plazo de un trabajo (timeout segundos [--signal SEÑAL] [--grace segundos] cmd), contado desde su arranque */
+typedef struct {
+	uint64_t after;          // ns; 0 si no hay plazo
+	uint64_t grace;          // ns entre la señal y SIGKILL; 0 para no insistir
+	int signal;
+} job_timeout;
+
+static const struct { const char *name; int signal; } signal_names[] = {
+	{ "HUP", SIGHUP }, { "INT", SIGINT }, { "QUIT", SIGQUIT }, { "KILL", SIGKILL },
+	{ "USR1", SIGUSR1 }, { "USR2", SIGUSR2 }, { "ALRM", SIGALRM }, { "TERM", SIGTERM }
+};
+
+/* TERM, SIGTERM o 15; -1 si no es una señal */
+int parse_signal(const char *s) {
+	char *end;
+	long n = strtol(s, &end, 10);
+	if (end != s && *end == '\0') return n > 0 && n < NSIG ? n : -1;
+	if (!strncmp(s, "SIG", 3)) s += 3;
+	for (size_t i = 0; i < sizeof(signal_names) / sizeof(signal_names[0]); i++)
+		if (!strcmp(s, signal_names[i].name)) return signal_names[i].signal;
+	return -1;
+}
+
+const char *signal_name(int signal) {
+	for (size_t i = 0; i < sizeof(signal_names) / sizeof(signal_names[0]); i++)
+		if (signal_names[i].signal == signal) return signal_names[i].name;
+	return "?";
+}
+
+/* Segundos (con decimales) a ns; 0 si no es un número positivo */
+uint64_t parse_seconds(const char *s) {
+	char *end;
+	double secs = strtod(s, &end);
+	return end != s && *end == '\0' && secs > 0 && secs < 1e9 ? (uint64_t) (secs * 1e9) : 0;
+}
+
+/* Quita de args el prefijo "timeout segundos [--signal SEÑAL] [--grace segundos]". -1 si está mal */
+int parse_timeout(char ***args, job_timeout *t) {
+	char **a = *args + 1;
+	*t = (job_timeout) { .signal = SIGTERM };
+	if (*a == NULL || (t->after = parse_seconds(*a++)) == 0) return -1;
+	while (*a != NULL && a[1] != NULL && (!strcmp(*a, "--signal") || !strcmp(*a, "--grace"))) {
+		if (!strcmp(*a, "--signal") && (t->signal = parse_signal(a[1])) == -1) return -1;
+		if (!strcmp(*a, "--grace") && (t->grace = parse_seconds(a[1])) == 0) return -1;
+		a += 2;
+	}
+	if (*a == NULL) return -1;
+	*args = a;
+	return 0;
+}
+
+/* El watchdog vigila el trabajo desde ahora */
+void set_timeout(job *the_job, const job_timeout *t) {
+	if (t->after == 0 || the_job->pgid <= 0) return;
+	the_job->timeout_signal = t->signal;
+	the_job->grace = t->signal == SIGKILL ? 0 : t->grace;
+	if (watchdog_set(the_job, stats_now() + t->after) == -1) perror("timeout");
+}
+
+/* Vence el plazo: la señal a todo el grupo y, si hay gracia y el trabajo sigue ahí al acabarla, SIGKILL */
+void on_deadline(job *the_job) {
+	if (the_job->pgid <= 0) return;
+	if (the_job->timed_out == 0) {
+		the_job->timed_out = 1;
+		printf("\nTimeout: pid: %d, command: %s, sending SIG%s\n", the_job->pgid, the_job->command,
+			signal_name(the_job->timeout_signal));
+		notify_job("timeout", the_job, state_strings[the_job->state], state_strings[the_job->state],
+			NULL, the_job->timeout_signal);
+		killpg(the_job->pgid, the_job->timeout_signal);
+		if (the_job->state == STOPPED) killpg(the_job->pgid, SIGCONT); // Suspendido no atendería la señal
+		if (the_job->grace) watchdog_set(the_job, stats_now() + the_job->grace);
+	}
+	else {
+		the_job->timed_out = 2;
+		printf("\nTimeout: pid: %d, command: %s, grace period over, sending SIGKILL\n", the_job->pgid, the_job->command);
+		notify_job("timeout", the_job, state_strings[the_job->state], state_strings[the_job->state], NULL, SIGKILL);
+		killpg(the_job->pgid, SIGKILL);
+	}
+	fflush(stdout);
+}
+
+/* Cola de ejecución de bgteam/parallel: como make -j, como mucho 'limit' trabajos a la vez */
+typedef struct team_item_ {
+	char **argv;             // Argumentos del elemento (bloque único con sus cadenas)
+	struct team_item_ *next;
+} team_item;
+
+typedef struct team_ {
+	int id;
+	int limit;               // Trabajos simultáneos como máximo
+	int running;
+	unsigned long repeat;    // bgteam: copias de 'argv' que faltan por lanzar
+	char **argv;             // bgteam: comando a repetir
+	team_item *head, *tail;  // parallel: elementos pendientes
+	unsigned long started;
+	job_timeout timeout;     // timeout bgteam ...: plazo de cada trabajo desde que arranca
+	launch_place place;      // nice/sched de cada trabajo; con taskset, cada uno va a una CPU del conjunto
+	int next_cpu;            // Última CPU asignada (reparto round-robin)
+	launch_limits limits;    // limit ... bgteam: límites de cada trabajo
+	struct team_ *next;
+} team;
+
+team *teams = NULL;
+int last_team_id = 0;
+
+/* Copia args (y sus cadenas) en un único bloque de memoria, añadiendo extra palabras al final */
+char **dup_argv(char **args, char **extra) {
+	size_t n = 0, bytes = 0;
+	for (char **a = args; *a; a++, n++) bytes += strlen(*a) + 1;
+	for (char **a = extra; a && *a; a++, n++) bytes += strlen(*a) + 1;
+	char **argv = malloc((n + 1) * sizeof(char *) + bytes);
+	if (argv == NULL) return NULL;
+	char *p = (char *) (argv + n + 1);
+	n = 0;
+	for (char **a = args; *a; a++) { argv[n++] = p; p = stpcpy(p, *a) + 1; }
+	for (char **a = extra; a && *a; a++) { argv[n++] = p; p = stpcpy(p, *a) + 1; }
+	argv[n] = NULL;
+	return argv;
+}
+
+/* Lanza elementos de la cola mientras haya huecos; libera el equipo cuando se ha vaciado */
+void team_fill(team *t) {
+	while (t->running < t->limit && (t->repeat > 0 || t->head != NULL)) {
+		team_item *item = NULL;
+		char **argv = t->argv;
+		if (t->repeat == 0) {
+			item = t->head;
+			t->head = item->next;
+			argv = item->argv;
+		}
+		else {
+			t->repeat--;
+		}
+
+		// Con taskset, cada trabajo a una sola CPU del conjunto, por turnos
+		launch_place place = t->place, bg_place;
+		if (t->place.has_cpus) {
+			int cpu = t->next_cpu;
+			do cpu = (cpu + 1) % CPU_SETSIZE; while (!CPU_ISSET(cpu, &t->place.cpus));
+			t->next_cpu = cpu;
+			CPU_ZERO(&place.cpus);
+			CPU_SET(cpu, &place.cpus);
+		}
+		launch_spec spec = { .argv = argv, .place = effective_place(&place, 1, &bg_place),
+			.limits = t->limits.set ? &t->limits : NULL };
+		struct capture_ *capture = capture_new(&spec.fd_out);
+		spec.fd_err = spec.fd_out;
+		pid_t pid = start_command(&spec);
+		if (capture != NULL) close(spec.fd_out);
+		job* the_job = NULL;
+		if (pid > 0) {
+			new_process_group(pid);
+			the_job = register_job(pid, argv[0], BACKGROUND);
+			if (the_job != NULL) {
+				the_job->team = t->id;
+				the_job->limits = t->limits;
+				set_timeout(the_job, &t->timeout);
+				t->running++;
+				t->started++;
+			}
+		}
+		if (capture != NULL) {
+			if (the_job != NULL) capture_bind(capture, the_job->pos, the_job->pgid, argv[0]);
+			else capture_cancel(capture);
+		}
+		free(item ? (void *) item->argv : NULL);
+		free(item);
+		if (pid == -1) { // No se pueden crear más procesos: descartamos lo pendiente
+			t->repeat = 0;
+			while (t->head != NULL) {
+				item = t->head;
+				t->head = item->next;
+				free(item->argv);
+				free(item);
+			}
+		}
+	}
+
+	if (t->running == 0 && t->repeat == 0 && t->head == NULL) {
+		printf("\nTeam %d finished: %lu jobs\n", t->id, t->started);
+		team **link = &teams;
+		while (*link != t) link = &(*link)->next;
+		*link = t->next;
+		free(t->argv);
+		free(t);
+	}
+}
+
+void team_job_done(int id) {
+	team *t = teams;
+	while (t != NULL && t->id != id) t = t->next;
+	if (t == NULL) return;
+	t->running--;
+	team_fill(t);
+}
+
+/* Añade un elemento de parallel: args del comando más las palabras de la línea */
+void team_add_line(team *t, char **args, char *line) {
+	char **words = malloc((strlen(line) / 2 + 2) * sizeof(char *)); // Cada palabra ocupa al menos 2 chars
+	int n = 0;
+	if (words == NULL) return;
+	for (char *w = strtok(line, " \t\n"); w != NULL; w = strtok(NULL, " \t\n")) {
+		words[n++] = w;
+	}
+	words[n] = NULL;
+
+	team_item *item = n > 0 ? malloc(sizeof(team_item)) : NULL; // Nada para una línea vacía
+	if (item == NULL || (item->argv = dup_argv(args, words)) == NULL) {
+		free(item);
+		free(words);
+		return;
 	}
+	free(words);
+	item->next = NULL;
+	if (t->head == NULL) t->head = item;
+	else t->tail->next = item;
+	t->tail = item;
+}
+
+/* Crea un equipo con límite de concurrencia; por defecto, el número de CPUs en línea */
+team *new_team(int limit) {
+	team *t = calloc(1, sizeof(team));
+	if (t == NULL) return NULL;
+	t->id = ++last_team_id;
+	t->next_cpu = -1;
+	t->limit = limit > 0 ? limit : (int) sysconf(_SC_NPROCESSORS_ONLN);
+	if (t->limit < 1) t->limit = 1;
+	t->next = teams;
+	teams = t;
+	return t;
+}
+
+/* Dependencias entre trabajos: after|afterok|afternotok N[,M...] comando.
+ * El sucesor entra en la lista como trabajo en espera (WAITING, sin procesos) y ya tiene su número,
+ * así que otros after pueden depender de él. Cuando el reaper recoge su último predecesor lo lanza
+ * en segundo plano, o lo cancela si alguno no ha acabado como pedía la condición */
+enum dep_cond { DEP_ANY, DEP_OK, DEP_NOTOK };
+
+typedef struct dep_ {
+	job *waiting;            // Trabajo en espera; NULL si se borró antes de que acabasen sus predecesores
+	enum dep_cond cond;
+	int pending;             // Predecesores que aún no han terminado
+	int blocked;             // Alguno terminó sin cumplir la condición: no se lanzará
+	char **argv;             // Palabras del comando (pipe_token incluido), en el mismo bloque
+	redirection *redirs;
+	int nredirs;
+} dep;
+
+typedef struct dep_edge_ {
+	dep *succ;
+	struct dep_edge_ *next;  // Siguiente sucesor del mismo predecesor
+} dep_edge;
+
+signed char *done_ok = NULL; // Por número de trabajo: cómo acabó el último que lo tuvo (1 bien, -1 mal, 0 no se sabe)
+int done_cap = 0;
+unsigned long waited_done;   // Trabajos marcados por wait que ya han salido de la lista
+int wait_interrupted;        // ^C durante wait
+
+/* Copia en un solo bloque las palabras y las redirecciones del comando; pipe_token se conserva tal cual */
+dep *new_dep(char **args, command_line *cmd, enum dep_cond cond) {
+	size_t n = 0, bytes = 0;
+	for (char **a = args; *a; a++, n++) if (*a != pipe_token) bytes += strlen(*a) + 1;
+	for (int r = 0; r < cmd->nredirs; r++) bytes += strlen(cmd->redirs[r].file) + 1;
+	dep *d = malloc(sizeof(dep) + cmd->nredirs * sizeof(redirection) + (n + 1) * sizeof(char *) + bytes);
+	if (d == NULL) return NULL;
+	d->waiting = NULL;
+	d->cond = cond;
+	d->pending = 0;
+	d->blocked = 0;
+	d->redirs = (redirection *) (d + 1);
+	d->nredirs = cmd->nredirs;
+	d->argv = (char **) (d->redirs + d->nredirs);
+	char *p = (char *) (d->argv + n + 1);
+	n = 0;
+	for (char **a = args; *a; a++) {
+		d->argv[n++] = *a == pipe_token ? pipe_token : p;
+		if (*a != pipe_token) p = stpcpy(p, *a) + 1;
+	}
+	d->argv[n] = NULL;
+	for (int r = 0; r < d->nredirs; r++) {
+		d->redirs[r] = cmd->redirs[r];
+		d->redirs[r].file = p;
+		p = stpcpy(p, cmd->redirs[r].file) + 1;
+	}
+	return d;
+}
+
+/* Ha terminado un predecesor (ok < 0: solo se descuenta); con el último, el trabajo en espera se lanza o se cancela */
+void dep_done(dep *d, int ok) {
+	static arena dep_arena;
+	if ((d->cond == DEP_OK && ok == 0) || (d->cond == DEP_NOTOK && ok > 0)) d->blocked = 1;
+	if (--d->pending > 0) return;
+
+	job *w = d->waiting;
+	if (w != NULL) {
+		w->dep = NULL;
+		if (!d->blocked) {
+			command_line c = { .mem = &dep_arena, .redirs = d->redirs, .nredirs = d->nredirs };
+			arena_reset(&dep_arena);
+			launch_into = w;
+			launch_line(d->argv, &c, 1, NULL, w->limits.set ? &w->limits : NULL); // limit N sobre el trabajo en espera
+			launch_into = NULL;
+		}
+		if (w->pgid == 0) { // Cancelado, o no se ha podido lanzar
+			printf("\nJob %d cancelled, dependency not satisfied: %s\n", w->pos, w->command);
+			trace_event(TRACE_STATE, 0, -1);
+			notify_job("state", w, state_strings[WAITING], "Done", NULL, 0);
+			finish_job(w, 0); // Sus propios sucesores también lo ven como fallido
+		}
+	}
+	free(d);
+}
+
+/* Un trabajo sale de la lista: se recuerda cómo acabó y se avisa a wait y a sus sucesores */
+void finish_job(job* the_job, int ok) {
+	int pos = the_job->pos;
+	if (pos >= done_cap) {
+		int cap = done_cap ? done_cap : 64;
+		while (cap <= pos) cap *= 2;
+		signed char *aux = realloc(done_ok, cap);
+		if (aux != NULL) {
+			memset(aux + done_cap, 0, cap - done_cap);
+			done_ok = aux;
+			done_cap = cap;
+		}
+	}
+	if (pos < done_cap) done_ok[pos] = ok ? 1 : -1;
+	if (the_job->waited) waited_done++;
+	if (the_job->dep != NULL) the_job->dep->waiting = NULL; // Borrado en espera: sus predecesores siguen avisando
+
+	dep_edge *e = the_job->successors;
+	drop_job(the_job);
+	while (e != NULL) {
+		dep_edge *next = e->next;
+		dep_done(e->succ, ok);
+		free(e);
+		e = next;
+	}
+}
+
+/* after[ok|notok] N[,M...] comando [| ...] [redirecciones]: el comando queda en espera de los trabajos N, M...
+ * Valen trabajos de la lista (también otros en espera) o ya terminados, según cómo acabaron */
+void after_command(char **args, command_line *cmd, enum dep_cond cond) {
+	int n = 1;
+	for (char *c = args[1]; *c; c++) if (*c == ',') n++;
+	job **preds = arena_alloc(cmd->mem, n * sizeof(job *)); // NULL: ya terminado, cómo acabó en done_ok[]
+	int *numbers = arena_alloc(cmd->mem, n * sizeof(int));
+	if (preds == NULL || numbers == NULL) return;
+	n = 0;
+	for (char *c = args[1], *end; *c; c = *end ? end + 1 : end) {
+		long pos = strtol(c, &end, 10);
+		if (end == c || (*end && *end != ',') || pos < 1 || pos > INT_MAX) {
+			printf("Usage: %s job[,job...] command [args]\n", args[0]);
+			return;
+		}
+		// Antes de dar número al sucesor, que puede reutilizar el de un trabajo terminado
+		preds[n] = get_item_bypos(job_list, pos);
+		if (preds[n] == NULL && (pos >= done_cap || done_ok[pos] == 0)) {
+			printf("%s: no such job: %ld\n", args[0], pos);
+			return;
+		}
+		numbers[n++] = pos;
+	}
+
+	// Nombre como el de launch_line(): la primera palabra de cada etapa
+	size_t len = 1;
+	for (char **a = args + 2; *a; a++) len += strlen(*a) + 3;
+	char *command = arena_alloc(cmd->mem, len);
+	if (command == NULL) return;
+	command[0] = '\0';
+	for (char **a = args + 2; *a; a++) {
+		if (*a == pipe_token) strcat(command, " | ");
+		else if (a == args + 2 || a[-1] == pipe_token) strcat(command, *a);
+	}
+
+	dep *d = new_dep(args + 2, cmd, cond);
+	job *w = d ? new_job(0, command, WAITING) : NULL;
+	if (w == NULL || !add_job(job_list, w)) {
+		perror("after");
+		if (w != NULL) free_job(w);
+		free(d);
+		return;
+	}
+	w->dep = d;
+	d->waiting = w;
+	d->pending = n + 1; // Uno de más mientras se enlaza: no puede arrancar a medias
+	trace_event(TRACE_STATE, 0, WAITING); // Aún sin grupo de procesos
+	notify_job("start", w, NULL, state_strings[WAITING], NULL, 0);
+
+	int pos = w->pos;
+	for (int i = 0; i < n; i++) {
+		job *pred = preds[i];
+		dep_edge *e = pred ? malloc(sizeof(dep_edge)) : NULL;
+		if (e != NULL) {
+			e->succ = d;
+			e->next = pred->successors;
+			pred->successors = e;
+		}
+		else { // Ya terminado (o sin memoria: cuenta como fallido)
+			dep_done(d, pred == NULL && done_ok[numbers[i]] > 0);
+		}
+	}
+	dep_done(d, -1); // El de más: lo lanza ya si no quedan predecesores vivos
+
+	if (get_item_bypos(job_list, pos) != w) return; // Cancelado, ya se ha informado
+	if (w->state == WAITING) {
+		printf("\nJob %d waiting for %s, command: %s\n", pos, args[1], w->command);
+	}
+	else {
+		printf("\nBackground job running... pid: %d, command: %s\n", w->pgid, w->command);
+	}
+}
+
+/* ^C mientras un builtin atiende el bucle de eventos (wait, output --follow): SIGINT (ignorada en
+ * modo interactivo) llega bloqueada por el signalfd y pone wait_interrupted */
+void catch_interrupt(int on) {
+	sigset_t with_int = shell_signals, int_only;
+	sigemptyset(&int_only);
+	sigaddset(&int_only, SIGINT);
+	if (on) {
+		sigaddset(&with_int, SIGINT);
+		sigprocmask(SIG_BLOCK, &int_only, NULL);
+		signalfd(sig_fd, &with_int, 0);
+		wait_interrupted = 0;
+		return;
+	}
+	signalfd(sig_fd, &shell_signals, 0);
+	struct timespec zero = { 0, 0 };
+	while (sigtimedwait(&int_only, NULL, &zero) > 0); // Un ^C que no ha llegado a leerse
+	if (!sigismember(&child_sigmask, SIGINT)) sigprocmask(SIG_UNBLOCK, &int_only, NULL);
+}
+
+/* wait [-n] [N...]: atiende eventos hasta que salen de la lista los trabajos N... (sin ellos, todos
+ * los que no están suspendidos), o solo el primero de ellos con -n. ^C deja de esperar */
+void wait_command(char **args) {
+	int a = 1, any = 0;
+	unsigned long marked = 0, finished = 0;
+	if (args[1] != NULL && !strcmp(args[1], "-n")) {
+		any = 1;
+		a++;
+	}
+	if (args[a] == NULL) {
+		job_iterator it = get_iterator(job_list);
+		while (has_next(it)) {
+			job *j = next(it);
+			if (j->state != STOPPED && !j->waited) {
+				j->waited = 1;
+				marked++;
+			}
+		}
+	}
+	for (; args[a] != NULL; a++) {
+		int pos = atoi(args[a]);
+		job *j = get_item_bypos(job_list, pos);
+		if (j != NULL) {
+			if (!j->waited) marked++;
+			j->waited = 1;
+		}
+		else if (pos > 0 && pos < done_cap && done_ok[pos]) finished++; // Ya terminado
+		else printf("wait: no such job: %s\n", args[a]);
+	}
+	unsigned long target = any && marked + finished > 0 ? 1 : marked + finished;
+	unsigned long base = waited_done;
+
+	catch_interrupt(1);
+	while (finished + (waited_done - base) < target && !wait_interrupted) {
+		if (ev_run_once(-1) == -1) {
+			perror("Wait error");
+			break;
+		}
+	}
+	catch_interrupt(0);
+	if (wait_interrupted) printf("\nwait: interrupted\n");
+
+	job_iterator it = get_iterator(job_list);
+	while (has_next(it)) next(it)->waited = 0;
+}
+
+/* output: capturas guardadas; output N | -p PID [--follow]: lo guardado del último trabajo con número N
+ * (o del grupo PID) y, con --follow, lo que le vaya llegando hasta que se cierre su salida o ^C */
+void output_command(char **args) {
+	if (args[1] == NULL) {
+		capture_list();
+		return;
+	}
+	int by_pid = !strcmp(args[1], "-p");
+	char **a = args + 1 + by_pid;
+	int follow = *a != NULL && a[1] != NULL && !strcmp(a[1], "--follow");
+	if (*a == NULL || (a[1] != NULL && (!follow || a[2] != NULL))) {
+		printf("Usage: output [job | -p pid] [--follow]\n");
+		return;
+	}
+	pid_t pgid = by_pid ? atoi(*a) : capture_lookup(atoi(*a));
+	fflush(stdout);
+	if (capture_print(pgid, STDOUT_FILENO) == -1) {
+		printf("output: no captured output for %s %s\n", by_pid ? "pid" : "job", *a);
+		return;
+	}
+	if (!follow || capture_follow(pgid, STDOUT_FILENO) != 1) return;
+	catch_interrupt(1);
+	while (capture_state(pgid) == 1 && !wait_interrupted) {
+		if (ev_run_once(-1) == -1) {
+			perror("Output error");
+			break;
+		}
+	}
+	catch_interrupt(0);
+	capture_follow(pgid, -1);
+	if (wait_interrupted) printf("\noutput: interrupted\n");
+}
+
+/* set capture on|off|TAMAÑO[K|M]: tamaño del anillo de cada trabajo, 0 si no se captura; -1 si está mal */
+long parse_capture(const char *s) {
+	if (!strcmp(s, "off")) return 0;
+	if (!strcmp(s, "on")) return CAPTURE_SIZE;
+	char *end;
+	long n = strtol(s, &end, 10);
+	if (*end == 'K' || *end == 'M') n <<= *end++ == 'K' ? 10 : 20;
+	return end != s && *end == '\0' && n > 0 && n <= CAPTURE_TOTAL ? n : -1;
+}
+
+/* Añade las estadísticas a un fichero abierto en modo append */
+void write_stats(int fd) {
+	FILE *fp = fdopen(dup(fd), "a");
+	if (fp == NULL) return;
+	stats_print(fp);
+	fprintf(fp, "\n");
+	fclose(fp);
+}
+
+/* Volcado de stats file, al salir (atexit) y con SIGHUP */
+void dump_stats(void) {
+	if (stats_fd >= 0) write_stats(stats_fd);
+}
+
+void on_signal(int fd, uint32_t events, void *data) {
+	struct signalfd_siginfo si;
+	int chld = 0;
+	while (read(fd, &si, sizeof(si)) == sizeof(si)) {
+		if (si.ssi_signo == SIGCHLD) {
+			chld = 1; // Varios SIGCHLD se atienden con una sola pasada del reaper
+		}
+		else if (si.ssi_signo == SIGINT) {
+			wait_interrupted = 1; // Solo se lee mientras wait espera
+		}
+		else if (si.ssi_signo == SIGHUP) {
+			log_event(LOG_SIGHUP, si.ssi_pid, 0, 0, NULL); // Lo escribe el hilo del log (hup.txt por defecto)
+			dump_stats();
+		}
+	}
+	if (chld) reap_children(ev_woken());
 }
 
 /* ---------------------------------------------- */
@@ -107,52 +1199,155 @@ void sighup_handler() {
 /**
  * MAIN
  **/
-int main(void)
+int main(int argc, char *argv[])
 {
-	char inputBuffer[MAX_LINE]; /* Buffer to hold the command entered */
 	int background;             /* Equals 1 if a command is followed by '&' */
-	char *args[MAX_LINE/2];     /* Command line (of 256) has max of 128 arguments */
-	/* Probably useful variables: */
-	int pid_fork, pid_wait; /* PIDs for created and waited processes */
-	int status;             /* Status returned by wait */
-	enum status status_res; /* Status processed by analyze_status() */
-	int info;				/* Info processed by analyze_status() */
-
-	FILE *in_file, *out_file;
-
-	/* ----------------- AMPLIACION ----------------- */
-
-	FILE *ap_file;
-
-	/* ---------------------------------------------- */
+	char **args;                /* Command line arguments (cmd.argv) */
+	command_line cmd = { .mem = &command_arena }; /* Arguments and redirections of the line */
+	unsigned long allocs_mark = 0;
+	char *line;
+	int length;
+
+	const char *command_string = NULL;
+	const char *serve_path = NULL;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+			command_string = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--status-fd") && i + 1 < argc) {
+			if (status_open_fd(atoi(argv[++i])) == -1) {
+				perror("--status-fd");
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (!strcmp(argv[i], "--serve") && i + 1 < argc) {
+			serve_path = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--status-socket") && i + 1 < argc) {
+			if (status_open_socket(argv[++i]) == -1) {
+				perror("--status-socket");
+				exit(EXIT_FAILURE);
+			}
+		}
+		else {
+			fprintf(stderr, "Usage: %s [-c command | --serve path] [--status-fd fd | --status-socket path]\n", argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+	interactive = command_string == NULL && serve_path == NULL && isatty(STDIN_FILENO);
+	if (!init_line_reader(&input, command_string ? -1 : STDIN_FILENO, command_string)) {
+		perror("Reader error");
+		exit(EXIT_FAILURE);
+	}
 
-	ignore_terminal_signals();
+	if (interactive) ignore_terminal_signals();
 	job_list = new_list("Job list");
-	signal(SIGCHLD, sigchld_handler);
+	atexit(dump_stats); // stats file
+
+	/* SIGCHLD y SIGHUP (AMPLIACION) no tienen manejador: llegan como eventos por un signalfd */
+	sigemptyset(&shell_signals);
+	sigaddset(&shell_signals, SIGCHLD);
+	sigaddset(&shell_signals, SIGHUP);
+	sigprocmask(SIG_BLOCK, &shell_signals, &child_sigmask);
+	sig_fd = signalfd(-1, &shell_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+
+	// El hilo del log arranca con todas las señales bloqueadas: todas llegan al signalfd
+	if (log_init("hup.txt") == -1) perror("Log error");
+	atexit(log_flush);
+
+	if (ev_init() == -1 || sig_fd == -1 || ev_add(sig_fd, EPOLLIN, on_signal, NULL) == -1) {
+		perror("Event loop error");
+		exit(EXIT_FAILURE);
+	}
+	if (watchdog_init(on_deadline) == -1) perror("Watchdog error"); // Sin él, timeout no pone plazos
+	if (serve_path != NULL) {
+		// Modo demonio: no se lee stdin, solo el socket, las señales y los trabajos
+		if (serve_open(serve_path, serve_line) == -1) {
+			perror("--serve");
+			exit(EXIT_FAILURE);
+		}
+		atexit(serve_close);
+		while (1) {
+			if (ev_run_once(-1) == -1) {
+				perror("Event loop error");
+				exit(EXIT_FAILURE);
+			}
+			status_flush();
+		}
+	}
+	if (command_string != NULL || ev_add(STDIN_FILENO, EPOLLIN, on_stdin, NULL) == -1) {
+		stdin_pollable = 0; // -c o fichero regular: siempre se puede leer
+	}
 
-	/* ----------------- AMPLIACION ----------------- */
+	while (1){   /* Program terminates normally after ^D is typed (end of the command stream) */
+		
+		/* Todo lo de la línea anterior se libera de una vez */
+		arena_reset(&command_arena);
+		status_flush(); // Eventos de la línea anterior (arranques, fg, bg)
+		last_command_allocs = mem_allocations() - allocs_mark;
+		allocs_mark = mem_allocations();
+
+		if (interactive) {
+			printf("\nCOMMAND->");
+			fflush(stdout);
+		}
 
-	signal(SIGHUP, sighup_handler);
+		/* Atendemos trabajos y señales hasta que haya algo que leer en stdin
+		 * (si ya hay una línea completa en el buffer no hace falta esperar) */
+		stdin_ready = !stdin_pollable || line_ready(&input);
+		ev_run_once(0);
+		while (!stdin_ready) {
+			if (ev_run_once(-1) == -1) {
+				perror("Event loop error");
+				exit(EXIT_FAILURE);
+			}
+		}
 
-	/* ---------------------------------------------- */
+		if ((line = read_line(&input, &length)) == NULL) {  /* Get next command */
+			if (length < 0) {
+				perror("error reading the command");
+				exit(-1);
+			}
+			if (interactive) printf("\nBye\n");
+			exit(0);            /* ^d was entered, end of user command stream */
+		}
+		trace_event(TRACE_PARSE_BEGIN, 0, length);
+		int parsed = tokenize_line(line, length, &cmd);
+		trace_event(TRACE_PARSE_END, 0, parsed == -1 ? -1 : cmd.argc);
+		if (parsed == -1) continue; /* Syntax error */
+		args = cmd.argv;
+		background = cmd.background;
 
-	while (1){   /* Program terminates normally inside get_command() after ^D is typed*/
-		
-		printf("\nCOMMAND->");
-		fflush(stdout);
-		get_command(inputBuffer, MAX_LINE, args, &background);  /* Get next command */
+		if(args[0]==NULL) continue;   /* Do nothing if empty command */
 
-		char *file_in, *file_out, *file_ap;
+		// time cmd: el trabajo se lanza igual y el reaper imprime su consumo al terminar
+		int timed = !strcmp(args[0], "time");
+		if (timed && *++args == NULL) {
+			printf("Usage: time command [args]\n");
+			continue;
+		}
 
-		/* ----------------- AMPLIACION ----------------- */
-		// Quitar de job_control.c y job_control.h todo lo de file_ap en parse_redirections
-		// Lo demás (file_in y file_out) es del básico
+		// timeout segundos [--signal SEÑAL] [--grace segundos] cmd: el watchdog mata el grupo si no ha acabado
+		job_timeout timeout = { 0 };
+		if (!strcmp(args[0], "timeout") && parse_timeout(&args, &timeout) == -1) {
+			printf("Usage: timeout seconds [--signal SIG] [--grace seconds] command [args]\n");
+			continue;
+		}
 
-		parse_redirections(args, &file_in, &file_out, &file_ap);
+		// taskset [-c] CPUS, nice [-n N], sched other|batch|idle: se aplican en el hijo antes del exec
+		launch_place place = { .has_cpus = 0 };
+		int placed = !strcmp(args[0], "taskset") || !strcmp(args[0], "nice") || !strcmp(args[0], "sched");
+		if (placed && parse_place(&args, &place) == -1) {
+			printf("Usage: [taskset [-c] cpu-list] [nice [-n N]] [sched other|batch|idle] command [args]\n");
+			continue;
+		}
 
-		/* ---------------------------------------------- */
-		
-		if(args[0]==NULL) continue;   /* Do nothing if empty command */
+		// limit nombre=valor... cmd (as, cpu, nofile, nproc): setrlimit en el hijo antes del exec
+		launch_limits limits = { .set = 0 };
+		if (!strcmp(args[0], "limit") && args[1] != NULL && strchr(args[1], '=') && parse_limits(&args, &limits) == -1) {
+			printf("Usage: limit as=SIZE[K|M|G|T] | cpu=SECONDS | nofile=N | nproc=N ... command [args]\n");
+			continue;
+		}
 
 		if (!strcmp(args[0], "cd")){
 			if (args[1] != NULL) {
@@ -176,68 +1371,43 @@ int main(void)
 			if (empty_list(job_list)){
 				printf("No Backgruond or Suspended jobs");
 			}
+			else if (args[1] != NULL && !strcmp(args[1], "-v")) {
+				print_list(job_list, print_item_placed); // Tiempo, consumo y ubicación de cada trabajo
+			}
 			else {
-				block_SIGCHLD();
 				print_job_list(job_list);
-				unblock_SIGCHLD();
 			}
 			continue;
 		}
 
 		if (!strcmp(args[0], "fg")){
-			int pos = 1;
-			if (args[1] != NULL){
-				pos = atoi(args[1]);
-			}
-			block_SIGCHLD();
-			job* the_job = get_item_bypos(job_list, pos);
-			unblock_SIGCHLD();
-
-			if (the_job != NULL) {
-				pid_t the_job_pgid = the_job->pgid;
-   				char* the_job_name = strdup(the_job->command);
-				set_terminal(the_job->pgid);
+			job* the_job = (args[1] != NULL) ? get_item_bypos(job_list, atoi(args[1])) : current_job(job_list);
 
-				if (the_job->state == STOPPED) {
-					killpg(the_job_pgid, SIGCONT);
+			if (the_job != NULL && the_job->state == WAITING) {
+				printf("Job %d is waiting for other jobs (after)\n", the_job->pos);
+			}
+			else if (the_job != NULL) {
+				// El trabajo conserva su número; el reaper informa cuando termina o se suspende
+				enum job_state old_state = the_job->state;
+				the_job->state = FOREGROUND;
+				trace_event(TRACE_STATE, the_job->pgid, FOREGROUND);
+				notify_job("fg", the_job, state_strings[old_state], state_strings[FOREGROUND], NULL, 0);
+				if (old_state == STOPPED) {
+					stats.continued++;
+					killpg(the_job->pgid, SIGCONT);
 				}
-
-				block_SIGCHLD();
-				delete_job(job_list, the_job);
-				unblock_SIGCHLD();
-
-				pid_wait = waitpid(the_job_pgid, &status, WUNTRACED);
-				set_terminal(getpid());
-
-				if (pid_wait == the_job_pgid) {
-                    status_res = analyze_status(status, &info);
-                    printf("\nForeground pid: %d, command: %s, %s, info: %d\n", the_job_pgid, the_job_name, status_strings[status_res], info);
-
-                    if (status_res == SUSPENDED) {
-                        block_SIGCHLD();
-                        add_job(job_list, new_job(pid_wait, the_job_name, STOPPED));
-                        unblock_SIGCHLD();
-                    }
-
-                } else if (pid_wait == -1) {
-                    printf("Wait error");
-                }
+				wait_foreground(the_job);
 			}
 			continue;
 		}
 
 		if (!strcmp(args[0], "bg")){
-			int pos = 1;
-			if (args[1] != NULL){
-				pos = atoi(args[1]);
-			}
-			
-			block_SIGCHLD();
-			job* the_job = get_item_bypos(job_list, pos);
-			unblock_SIGCHLD();
+			job* the_job = (args[1] != NULL) ? get_item_bypos(job_list, atoi(args[1])) : current_job(job_list);
 
 			if (the_job != NULL && the_job->state == STOPPED) {
 				the_job->state = BACKGROUND;
+				trace_event(TRACE_STATE, the_job->pgid, BACKGROUND);
+				notify_job("bg", the_job, state_strings[STOPPED], state_strings[BACKGROUND], NULL, 0);
 				killpg(the_job->pgid, SIGCONT);
 				printf("\nBackground job running... pid: %d, command: %s\n", the_job->pgid, the_job->command);
 			}
@@ -251,10 +1421,8 @@ int main(void)
 				printf("No hay trabajo actual");
 				continue;
 			}
-			block_SIGCHLD();
-			job* the_job = get_item_bypos(job_list, 1);
+			job* the_job = current_job(job_list);
 			printf("Trabajo actual: PID=%d command=%s", the_job->pgid, the_job->command);
-			unblock_SIGCHLD();
 			continue;
 		}
 
@@ -264,19 +1432,11 @@ int main(void)
 				continue;
 			}
 
-			int pos = 1;
-			if (args[1] != NULL){
-				pos = atoi(args[1]);
-			}
-			block_SIGCHLD();
-			job* the_job = get_item_bypos(job_list, pos);
-			unblock_SIGCHLD();
+			job* the_job = (args[1] != NULL) ? get_item_bypos(job_list, atoi(args[1])) : current_job(job_list);
 
 			if (the_job != NULL && the_job->state != STOPPED){
-				block_SIGCHLD();
-				delete_job(job_list, the_job);
 				printf("Borrando trabajo actual de la lista de jobs: PID=%d command=%s", the_job->pgid, the_job->command);
-				unblock_SIGCHLD();
+				finish_job(the_job, 0); // Sus sucesores (after) lo ven como fallido
 			}
 			else {
 				printf("No se permiten borrar trabajos en segundo plano suspendidos");
@@ -284,147 +1444,265 @@ int main(void)
 			continue;
 		}
 
+		if (!strcmp(args[0], "after") || !strcmp(args[0], "afterok") || !strcmp(args[0], "afternotok")){
+			// after: cuando terminen; afterok: si todos acaban con 0; afternotok: si todos fallan
+			enum dep_cond cond = !strcmp(args[0], "afterok") ? DEP_OK : !strcmp(args[0], "afternotok") ? DEP_NOTOK : DEP_ANY;
+			if (args[1] == NULL || args[2] == NULL || args[2] == pipe_token) {
+				printf("Usage: %s job[,job...] command [args]\n", args[0]);
+			}
+			else {
+				after_command(args, &cmd, cond);
+			}
+			continue;
+		}
+
+		if (!strcmp(args[0], "wait")){
+			wait_command(args);
+			continue;
+		}
+
 		if(!strcmp(args[0], "zjobs")){ 
-			block_SIGCHLD();
 			traverse_proc();
-			unblock_SIGCHLD();
 			continue;
 		}
 
-		if(!strcmp(args[0], "bgteam")){ 
-			if (args[2] == NULL){
-				printf("El comando bgteam requiere dos argumentos");
-				continue;
-			}
-			int n = atoi(args[1]);
-			if (n > 0){
-				block_SIGCHLD();
-				for (int i=0; i<n; i++){
-					pid_fork = fork();
-					if (pid_fork == 0){ // Hijo
-						new_process_group(getpid());
-						restore_terminal_signals();
-						execvp(args[2], &args[2]);
-						printf("\nError, command not found: %s\n", args[0]);
-						exit(EXIT_FAILURE);
-					}
-					else {
-						add_job(job_list, new_job(pid_fork, args[2], BACKGROUND));
-					}
-				}
-				unblock_SIGCHLD();
-			}
+		if(!strcmp(args[0], "reapstat")){
+			printf("events: %lu, waitpid calls: %lu, reaped: %lu, stray: %lu, max batch: %lu, time: %lld us",
+				reap_stats.events, reap_stats.waits, reap_stats.reaped, reap_stats.stray,
+				reap_stats.max_batch, reap_stats.ns / 1000);
+			if (reap_stats.events) printf(" (%lld ns/event)", reap_stats.ns / (long long) reap_stats.events);
+			printf("\n");
 			continue;
 		}
 
-		/* ------------------------------------------------ */
+		if(!strcmp(args[0], "memstat")){
+			printf("arena: %zu bytes in use, %lu chunk allocations\n", arena_used(&command_arena), mem_stats.arena_chunks);
+			printf("slabs: %lu refills, %lu large strings, %lu strings in use\n",
+				mem_stats.slab_refills, mem_stats.large_allocs, mem_stats.strings_used);
+			printf("job/process pools: %lu refills\n", mem_stats.pool_refills);
+			printf("allocations (%s): %lu last command, %lu total\n", mem_stats.heap_counted ? "whole heap" : "pools only",
+				last_command_allocs, mem_allocations());
+			continue;
+		}
 
-		pid_fork = fork();
+		if(!strcmp(args[0], "trace")){
+			// trace dump [fichero] | clear | on | off: JSON para chrome://tracing
+			if (args[1] != NULL && !strcmp(args[1], "dump")) {
+				int fd = STDOUT_FILENO;
+				if (args[2] != NULL && (fd = open(args[2], O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) == -1) {
+					perror("trace");
+					continue;
+				}
+				fflush(stdout);
+				if (trace_dump(fd) == -1) perror("trace");
+				if (fd != STDOUT_FILENO) close(fd);
+			}
+			else if (args[1] != NULL && !strcmp(args[1], "clear")) trace_clear();
+			else if (args[1] != NULL && !strcmp(args[1], "on")) trace_enabled = 1;
+			else if (args[1] != NULL && !strcmp(args[1], "off")) trace_enabled = 0;
+			else printf("Usage: trace dump [file] | clear | on | off\n");
+			continue;
+		}
 
-		if (pid_fork > 0){ // Padre
-			new_process_group(pid_fork);
+		if(!strcmp(args[0], "stats")){
+			// stats [reset | dump fichero | file fichero|off]
+			if (args[1] == NULL) stats_print(stdout);
+			else if (!strcmp(args[1], "reset")) stats_reset();
+			else if ((!strcmp(args[1], "dump") || !strcmp(args[1], "file")) && args[2] != NULL) {
+				int fd = -1;
+				if (strcmp(args[2], "off") && (fd = open(args[2], O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644)) == -1) {
+					perror("stats");
+					continue;
+				}
+				if (!strcmp(args[1], "dump")) {
+					if (fd >= 0) write_stats(fd), close(fd);
+				}
+				else { // El fichero queda abierto: cd no cambia a dónde se vuelca
+					if (stats_fd >= 0) close(stats_fd);
+					stats_fd = fd;
+				}
+			}
+			else printf("Usage: stats [reset | dump file | file file|off]\n");
+			continue;
+		}
 
-			if (!background){ // Foreground
-				set_terminal(pid_fork);
-				pid_wait = waitpid(pid_fork, &status, WUNTRACED);
-				set_terminal(getpid());
-
-				if (pid_wait == pid_fork){
-					status_res = analyze_status(status, &info);
-					printf("\nForeground pid: %d, command: %s, %s, info: %d\n", pid_fork, args[0], status_strings[status_res], info);
-
-					if (status_res == SUSPENDED){
-						block_SIGCHLD();
-						add_job(job_list, new_job(pid_fork, args[0], STOPPED));
-						unblock_SIGCHLD();
-					}
+		if(!strcmp(args[0], "log")){
+			// log [file fichero|off] [jobs on|off]
+			int a = 1, ok = 1;
+			for (; ok && args[a] != NULL && args[a+1] != NULL; a += 2) {
+				if (!strcmp(args[a], "file")) {
+					if (log_set_file(strcmp(args[a+1], "off") ? args[a+1] : NULL) == -1) perror("log");
 				}
-				else if (pid_wait == -1){
-					perror("Wait error");
+				else if (!strcmp(args[a], "jobs") && (!strcmp(args[a+1], "on") || !strcmp(args[a+1], "off"))) {
+					log_jobs = !strcmp(args[a+1], "on");
 				}
+				else ok = 0;
 			}
-			else { // Background
-				printf("\nBackground job running... pid: %d, command: %s\n", pid_fork, args[0]);
-				block_SIGCHLD();
-				add_job(job_list, new_job(pid_fork, args[0], BACKGROUND));
-				unblock_SIGCHLD();
+			if (!ok || args[a] != NULL) {
+				printf("Usage: log [file file|off] [jobs on|off]\n");
 			}
-		}
-		else if (pid_fork == 0){ // Hijo
-			new_process_group(getpid());
-			if (!background) {
-				set_terminal(getpid());
+			else if (a == 1) {
+				log_flush();
+				printf("file %s, jobs %s, written %llu, batches %llu, dropped %llu, errors %llu\n",
+					log_file() ? log_file() : "off", log_jobs ? "on" : "off",
+					(unsigned long long) __atomic_load_n(&log_stats.written, __ATOMIC_RELAXED),
+					(unsigned long long) __atomic_load_n(&log_stats.batches, __ATOMIC_RELAXED),
+					(unsigned long long) __atomic_load_n(&log_stats.dropped, __ATOMIC_RELAXED),
+					(unsigned long long) __atomic_load_n(&log_stats.errors, __ATOMIC_RELAXED));
 			}
-			restore_terminal_signals();	
+			continue;
+		}
 
-			if (file_in) {
-				in_file = fopen(file_in, "r");
+		if(!strcmp(args[0], "output")){
+			// output [N | -p PID] [--follow]: salida capturada de un trabajo en segundo plano (set capture on)
+			output_command(args);
+			continue;
+		}
 
-				if (in_file == NULL) {
-					perror("Redirecition error.");
-					exit(EXIT_FAILURE);
-				}
-				
-				if (dup2(fileno(in_file), STDIN_FILENO) == -1) {
-					perror("Redirection error");
-					exit(EXIT_FAILURE);
-				}
+		if(!strcmp(args[0], "limit")){
+			// limit [N [nombre=valor...]]: con nombre=valor y un comando es el prefijo de lanzamiento
+			limit_command(args);
+			continue;
+		}
 
-				fclose(in_file);
+		if(!strcmp(args[0], "zygote")){
+			// zygote [size N]: hijos ya creados que esperan un comando (set spawn zygote)
+			if (args[1] != NULL && !strcmp(args[1], "size") && args[2] != NULL && atoi(args[2]) > 0) {
+				if (zygote_running()) zygote_resize(atoi(args[2]));
+				else zygote_stats.pool = atoi(args[2]) < ZYGOTE_MAX_POOL ? atoi(args[2]) : ZYGOTE_MAX_POOL;
+			}
+			else if (args[1] != NULL) {
+				printf("Usage: zygote [size N]\n");
 			}
+			else {
+				unsigned long launches = zygote_stats.hits + zygote_stats.misses + zygote_stats.fallbacks;
+				printf("%s, pool %d, ready %d, hits %lu, misses %lu, fallbacks %lu, hit rate %.1f%%\n",
+					zygote_running() ? "running" : "stopped", zygote_stats.pool, zygote_stats.ready,
+					zygote_stats.hits, zygote_stats.misses, zygote_stats.fallbacks,
+					launches ? 100.0 * zygote_stats.hits / launches : 0.0);
+			}
+			continue;
+		}
 
-			if (file_out) {
-				out_file = fopen(file_out, "w");
+		if(!strcmp(args[0], "hash")){
+			if (args[1] != NULL && !strcmp(args[1], "-r")){
+				path_clear();
+			}
+			else {
+				print_path_cache();
+			}
+			continue;
+		}
 
-				if (out_file == NULL) {
-					perror("Redirecition error.");
-					exit(EXIT_FAILURE);
-				}
-				
-				if (dup2(fileno(out_file), STDOUT_FILENO) == -1) {
-					perror("Redirection error");
-					exit(EXIT_FAILURE);
+		if(!strcmp(args[0], "set")){
+			if (args[1] == NULL){
+				printf("spawn %s\n", launch_mode_strings[launch_mode]);
+				printf("splice %s\n", splice_stages ? "on" : "off");
+				printf("bgsched %s\n", bg_policy == -1 ? "off" : policy_name(bg_policy));
+				if (capture_stats.size) printf("capture %zu\n", capture_stats.size);
+				else printf("capture off\n");
+			}
+			else if (!strcmp(args[1], "spawn") && args[2] != NULL && parse_launch_mode(args[2]) != -1){
+				int mode = parse_launch_mode(args[2]);
+				if (mode == LAUNCH_ZYGOTE && zygote_start(zygote_stats.pool) == -1) {
+					perror("zygote"); // Se queda el modo anterior
+					continue;
 				}
-
-				fclose(out_file);
+				launch_mode = mode;
 			}
+			else if (!strcmp(args[1], "splice") && args[2] != NULL && (!strcmp(args[2], "on") || !strcmp(args[2], "off"))){
+				splice_stages = !strcmp(args[2], "on");
+			}
+			else if (!strcmp(args[1], "bgsched") && args[2] != NULL && (!strcmp(args[2], "off") || parse_policy(args[2]) != -1)){
+				bg_policy = !strcmp(args[2], "off") ? -1 : parse_policy(args[2]);
+			}
+			else if (!strcmp(args[1], "capture") && args[2] != NULL && parse_capture(args[2]) != -1){
+				capture_stats.size = parse_capture(args[2]); // Los trabajos ya lanzados siguen como estaban
+			}
+			else {
+				printf("Usage: set [spawn fork|vfork|zygote] [splice on|off] [bgsched batch|idle|other|off]"
+					" [capture on|off|size[K|M]]\n");
+			}
+			continue;
+		}
 
-			/* ----------------- AMPLIACION ----------------- */
-
-			if (file_ap) {
-				ap_file = fopen(file_ap, "a");
+		if(!strcmp(args[0], "bgteam") || !strcmp(args[0], "parallel")){
+			// bgteam [-j N] N cmd [args]   |   parallel [-j N] [-a file] cmd [args] (un elemento por línea)
+			int is_team = !strcmp(args[0], "bgteam");
+			int limit = 0, a = 1;
+			char *items_file = NULL;
+			while (args[a] != NULL && args[a+1] != NULL) {
+				if (!strcmp(args[a], "-j")) limit = atoi(args[a+1]);
+				else if (!is_team && !strcmp(args[a], "-a")) items_file = args[a+1];
+				else break;
+				a += 2;
+			}
+			if (args[a] == NULL || (is_team && args[a+1] == NULL)){
+				if (is_team) printf("El comando bgteam requiere dos argumentos");
+				else printf("Usage: parallel [-j N] [-a file] cmd [args]");
+				continue;
+			}
 
-				if (ap_file == NULL) {
-					perror("Redirecition error.");
-					exit(EXIT_FAILURE);
-				}
-				
-				if (dup2(fileno(ap_file), STDOUT_FILENO) == -1) {
-					perror("Redirection error");
-					exit(EXIT_FAILURE);
+			FILE *items = NULL;
+			unsigned long n = 0;
+			if (is_team){
+				n = strtoul(args[a], NULL, 10);
+				a++;
+				if (n == 0) continue;
+			}
+			else {
+				if (items_file && (items = fopen(items_file, "r")) == NULL){
+					perror("parallel");
+					continue;
 				}
+			}
 
-				fclose(ap_file);
+			team *t = new_team(limit);
+			if (t != NULL) {
+				t->timeout = timeout;
+				t->place = place;
+				t->limits = limits;
+			}
+			if (t == NULL || (t->argv = dup_argv(&args[a], NULL)) == NULL){
+				perror("Team error");
+				if (items) fclose(items);
+				continue;
+			}
+			t->repeat = n;
+			if (items){
+				char *line = NULL;
+				size_t cap = 0;
+				while (getline(&line, &cap, items) != -1) team_add_line(t, t->argv, line);
+				free(line);
+				fclose(items);
 			}
+			else if (!is_team){ // Elementos desde stdin: se leen con el mismo lector que los comandos
+				char *line;
+				int length;
+				while ((line = read_line(&input, &length)) != NULL) {
+					line[length - 1] = '\0'; // Cambiamos el '\n' final: la línea no acaba en '\0'
+					team_add_line(t, t->argv, line);
+				}
+				if (isatty(input.fd)) input.eof = 0; // En un terminal ^D solo acaba los elementos, no el shell
+			}
+			team_fill(t);
+			continue;
+		}
 
-			/* ---------------------------------------------- */
+		/* ------------------------------------------------ */
 
-			/* ----------------- AMPLIACION ----------------- */
-			// Dejar solo execvp(args[0], args); sin nigún if
+		job* the_job = launch_line(args, &cmd, background, placed ? &place : NULL, limits.set ? &limits : NULL);
 
-			if (!strcmp(args[0], "fico")){
-				execvp("./cuentafich.sh", args);
-				//execvp("/home/borja/Shell-SSOO/cuentafich.sh", args);
+		if (the_job != NULL){
+			the_job->timed = timed;
+			set_timeout(the_job, &timeout);
+			if (!background){ // Foreground
+				// También va a la lista: el reaper lo recoge y, si se suspende, ya queda como STOPPED
+				wait_foreground(the_job);
 			}
-			else {
-				execvp(args[0], args);
+			else { // Background
+				printf("\nBackground job running... pid: %d, command: %s\n", the_job->pgid, the_job->command);
 			}
-
-			/* ---------------------------------------------- */
-			
-			// Si falla, continua por aquí
-			printf("\nError, command not found: %s\n", args[0]);
-			exit(EXIT_FAILURE);
 		}
 
 	} /* End while */
@@ -0,0 +1,104 @@
+/**
+ * Linux Job Control Shell Project
+ * stats module
+ *
+ * Values below 2^HIST_SUB_BITS get a bucket each. Above that, a value with
+ * its top bit at position e goes to one of the 2^HIST_SUB_BITS buckets
+ * of its power of two, chosen by the next HIST_SUB_BITS bits. Recording is
+ * a clz, a shift and an increment. Percentiles report the upper bound of
+ * their bucket.
+ **/
+#include <string.h>
+#include <time.h>
+#include "stats.h"
+
+shell_stats stats = {
+	.spawn = { .name = "spawn-to-exec" },
+	.foreground = { .name = "foreground wall" },
+	.reap = { .name = "sigchld-to-reap" },
+};
+
+static unsigned hist_index(uint64_t v)
+{
+	if (v < (1u << HIST_SUB_BITS)) return v;
+	unsigned e = 63 - __builtin_clzll(v);
+	unsigned sub = (v >> (e - HIST_SUB_BITS)) & ((1u << HIST_SUB_BITS) - 1);
+	return ((e - HIST_SUB_BITS + 1) << HIST_SUB_BITS) + sub;
+}
+
+/* Largest value that falls in bucket i */
+static uint64_t hist_upper(unsigned i)
+{
+	if (i < (1u << HIST_SUB_BITS)) return i;
+	unsigned e = (i >> HIST_SUB_BITS) + HIST_SUB_BITS - 1;
+	uint64_t sub = i & ((1u << HIST_SUB_BITS) - 1);
+	uint64_t low = (1ULL << e) | (sub << (e - HIST_SUB_BITS));
+	return low + (1ULL << (e - HIST_SUB_BITS)) - 1;
+}
+
+void hist_record(histogram * h, uint64_t value)
+{
+	h->buckets[hist_index(value)]++;
+	h->count++;
+	h->sum += value;
+	if (value > h->max) h->max = value;
+}
+
+/**
+ * Value below which a fraction p (0..1) of the samples fall
+ **/
+uint64_t hist_percentile(const histogram * h, double p)
+{
+	if (h->count == 0) return 0;
+	uint64_t rank = (uint64_t) (p * h->count + 0.5), seen = 0;
+	if (rank == 0) rank = 1;
+	for (unsigned i = 0; i < HIST_BUCKETS; i++)
+	{
+		seen += h->buckets[i];
+		if (seen >= rank)
+		{
+			uint64_t v = hist_upper(i);
+			return v < h->max ? v : h->max;
+		}
+	}
+	return h->max;
+}
+
+uint64_t stats_now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+void stats_reset(void)
+{
+	histogram * h[] = { &stats.spawn, &stats.foreground, &stats.reap };
+	for (int i = 0; i < 3; i++)
+	{
+		const char * name = h[i]->name;
+		memset(h[i], 0, sizeof(histogram));
+		h[i]->name = name;
+	}
+	stats.started = stats.reaped = stats.suspended = stats.continued = 0;
+}
+
+static void hist_print(FILE * out, const histogram * h)
+{
+	fprintf(out, "%-16s count %llu", h->name, (unsigned long long) h->count);
+	if (h->count)
+		fprintf(out, ", mean %.1fus, p50 %.1fus, p90 %.1fus, p99 %.1fus, max %.1fus",
+			h->sum / (double) h->count / 1000, hist_percentile(h, 0.5) / 1000.0,
+			hist_percentile(h, 0.9) / 1000.0, hist_percentile(h, 0.99) / 1000.0, h->max / 1000.0);
+	fprintf(out, "\n");
+}
+
+void stats_print(FILE * out)
+{
+	fprintf(out, "jobs: started %llu, reaped %llu, suspended %llu, continued %llu\n",
+		(unsigned long long) stats.started, (unsigned long long) stats.reaped,
+		(unsigned long long) stats.suspended, (unsigned long long) stats.continued);
+	hist_print(out, &stats.spawn);
+	hist_print(out, &stats.foreground);
+	hist_print(out, &stats.reap);
+}
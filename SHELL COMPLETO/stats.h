@@ -0,0 +1,48 @@
+/**
+ * Linux Job Control Shell Project
+ * Function prototypes and types for stats module
+ *
+ * Running aggregates for the stats builtin: log-linear (HDR style)
+ * latency histograms and job counters, all in fixed static memory.
+ **/
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define HIST_SUB_BITS 4                       /* 16 sub-buckets per power of two: ~6% resolution */
+#define HIST_BUCKETS  ((64 - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+
+typedef struct
+{
+	const char * name;
+	uint64_t count;
+	uint64_t sum;
+	uint64_t max;
+	uint64_t buckets[HIST_BUCKETS];
+} histogram;
+
+typedef struct
+{
+	histogram spawn;      /* fork/clone to successful exec, ns */
+	histogram foreground; /* Wall time of foreground jobs, ns */
+	histogram reap;       /* epoll_wait returning the SIGCHLD/pidfd event to wait4 return, ns */
+	uint64_t started;
+	uint64_t reaped;
+	uint64_t suspended;
+	uint64_t continued;
+} shell_stats;
+
+extern shell_stats stats;
+
+/**
+ * Public Functions
+ **/
+void hist_record(histogram * h, uint64_t value);
+uint64_t hist_percentile(const histogram * h, double p);
+void stats_reset(void);
+void stats_print(FILE * out);
+uint64_t stats_now(void);
+
+#endif
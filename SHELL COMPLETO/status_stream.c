@@ -0,0 +1,221 @@
+/**
+ * Linux Job Control Shell Project
+ * status_stream module
+ *
+ * The stream fd is non-blocking: a reader that falls behind does not stop
+ * the shell. What it has not taken stays in the buffer, up to
+ * STATUS_BUFFER_MAX bytes; past that, new events are counted and dropped,
+ * never cut in the middle of a line.
+ **/
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "status_stream.h"
+
+static int status_fd = -1;
+static char * buf;
+static size_t len, cap;
+static unsigned long dropped;
+
+static int set_stream_fd(int fd)
+{
+	int flags = fcntl(fd, F_GETFL);
+	if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1 ||
+	    fcntl(fd, F_SETFD, FD_CLOEXEC) == -1) /* Commands must not inherit it */
+		return -1;
+	status_fd = fd;
+	return 0;
+}
+
+/* write() for a pipe or file: SIGPIPE is held back while it runs, so a
+ * reader that has gone away returns EPIPE instead of killing the shell */
+static ssize_t write_nosignal(int fd, const void * data, size_t n)
+{
+	sigset_t pipe_only, old;
+	sigemptyset(&pipe_only);
+	sigaddset(&pipe_only, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &pipe_only, &old);
+	ssize_t w = write(fd, data, n);
+	if (w == -1 && errno == EPIPE)
+	{
+		/* Discard the SIGPIPE raised by this write before unblocking it */
+		sigtimedwait(&pipe_only, NULL, &(struct timespec) { 0, 0 });
+		errno = EPIPE;
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	return w;
+}
+
+/**
+ * Streams events to an fd inherited from the parent (--status-fd N).
+ * Returns -1 if fd is not open
+ **/
+int status_open_fd(int fd)
+{
+	return set_stream_fd(fd);
+}
+
+/**
+ * Streams events to a listening Unix socket (--status-socket PATH).
+ * Returns -1 if it cannot connect
+ **/
+int status_open_socket(const char * path)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	if (strlen(path) >= sizeof(addr.sun_path))
+	{
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd == -1) return -1;
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1 || set_stream_fd(fd) == -1)
+	{
+		close(fd);
+		return -1;
+	}
+	return 0;
+}
+
+static int reserve(size_t n)
+{
+	if (len + n <= cap) return 0;
+	size_t new_cap = cap ? cap : 4096;
+	while (new_cap < len + n) new_cap *= 2;
+	char * aux = realloc(buf, new_cap);
+	if (aux == NULL) return -1;
+	buf = aux;
+	cap = new_cap;
+	return 0;
+}
+
+/* Appends s as a JSON string, or null */
+static void put_string(char * out, size_t * n, const char * s)
+{
+	if (s == NULL)
+	{
+		memcpy(out + *n, "null", 4);
+		*n += 4;
+		return;
+	}
+	out[(*n)++] = '"';
+	for (; *s; s++)
+	{
+		unsigned char c = *s;
+		if (c == '"' || c == '\\')
+		{
+			out[(*n)++] = '\\';
+			out[(*n)++] = c;
+		}
+		else if (c < 0x20) *n += sprintf(out + *n, "\\u%04x", c);
+		else out[(*n)++] = c;
+	}
+	out[(*n)++] = '"';
+}
+
+/* Writes the event line into out, which has room for line_max(item) bytes */
+static size_t format_event(char * out, const char * event, job * item, const char * old_state,
+                           const char * new_state, const char * status, int info, unsigned long lost)
+{
+	struct timespec now, mono;
+	clock_gettime(CLOCK_REALTIME, &now);
+	clock_gettime(CLOCK_MONOTONIC, &mono);
+	double elapsed = (mono.tv_sec - item->start.tv_sec) + (mono.tv_nsec - item->start.tv_nsec) / 1e9;
+
+	size_t n = sprintf(out, "{\"event\":\"%s\",\"job\":%d,\"pgid\":%d,\"command\":", event, item->pos, item->pgid);
+	put_string(out, &n, item->command);
+	memcpy(out + n, ",\"old\":", 7);
+	n += 7;
+	put_string(out, &n, old_state);
+	memcpy(out + n, ",\"new\":", 7);
+	n += 7;
+	put_string(out, &n, new_state);
+	memcpy(out + n, ",\"status\":", 10);
+	n += 10;
+	put_string(out, &n, status);
+	if (status) n += sprintf(out + n, ",\"info\":%d", info);
+	else n += sprintf(out + n, ",\"info\":null");
+	n += sprintf(out + n, ",\"time\":%ld.%06ld,\"elapsed\":%.6f", (long) now.tv_sec, now.tv_nsec / 1000, elapsed);
+	if (lost) n += sprintf(out + n, ",\"dropped\":%lu", lost); /* Events lost before this one */
+	memcpy(out + n, "}\n", 2);
+	return n + 2;
+}
+
+static size_t line_max(job * item)
+{
+	return 256 + 6 * strlen(item->command);
+}
+
+/**
+ * Formats an event line without queueing it (for other destinations, like
+ * the clients of serve.c). The result is valid until the next call
+ **/
+const char * status_format(const char * event, job * item, const char * old_state, const char * new_state,
+                           const char * status, int info, size_t * length)
+{
+	static char * line;
+	static size_t line_cap;
+	size_t need = line_max(item);
+	if (need > line_cap)
+	{
+		char * aux = realloc(line, need);
+		if (aux == NULL) return NULL;
+		line = aux;
+		line_cap = need;
+	}
+	*length = format_event(line, event, item, old_state, new_state, status, info, 0);
+	return line;
+}
+
+/**
+ * Queues one event line for item. Nothing is written until status_flush()
+ **/
+void status_event(const char * event, job * item, const char * old_state, const char * new_state,
+                  const char * status, int info)
+{
+	if (status_fd < 0) return;
+	if (len + line_max(item) > STATUS_BUFFER_MAX || reserve(line_max(item)) == -1)
+	{
+		dropped++;
+		return;
+	}
+	len += format_event(buf + len, event, item, old_state, new_state, status, info, dropped);
+	dropped = 0;
+}
+
+/**
+ * Writes the queued lines, as much as the reader takes without blocking
+ **/
+void status_flush(void)
+{
+	if (status_fd < 0 || len == 0) return;
+	size_t done = 0;
+	while (done < len)
+	{
+		/* A reader that has gone away gives EPIPE, never SIGPIPE: MSG_NOSIGNAL for
+		 * sockets, SIGPIPE blocked around the write for pipes */
+		ssize_t w = send(status_fd, buf + done, len - done, MSG_NOSIGNAL);
+		if (w == -1 && errno == ENOTSOCK) w = write_nosignal(status_fd, buf + done, len - done);
+		if (w > 0)
+		{
+			done += w;
+			continue;
+		}
+		if (w == -1 && errno == EINTR) continue;
+		if (w == -1 && errno != EAGAIN)
+		{
+			/* Reader gone: stop streaming */
+			close(status_fd);
+			status_fd = -1;
+			done = len;
+		}
+		break;
+	}
+	memmove(buf, buf + done, len - done);
+	len -= done;
+}
@@ -0,0 +1,36 @@
+/**
+ * Linux Job Control Shell Project
+ * Function prototypes for status_stream module
+ *
+ * Machine-readable job events: one JSON object per line, for supervisors
+ * that would otherwise scrape the "Background pid: ..." messages. Lines
+ * are buffered and written by status_flush(), which the shell calls once
+ * per reaper pass and once per command, so a burst of reaps costs a
+ * single write. Example line:
+ *
+ *   {"event":"state","job":3,"pgid":4242,"command":"sleep","old":"Background",
+ *    "new":"Done","status":"Exited","info":0,"time":1760707200.123456,"elapsed":2.001}
+ *
+ * "event" is "start", "state", "fg"/"bg" or "timeout". "new" is a job state, or
+ * "Done" when the job has left the list. "status"/"info" come from wait, null
+ * for changes made by the shell itself; for "timeout", info is the signal sent.
+ **/
+#ifndef _STATUS_STREAM_H
+#define _STATUS_STREAM_H
+
+#include "job_control.h"
+
+#define STATUS_BUFFER_MAX (1 << 20) /* Unsent bytes kept for a slow reader before dropping events */
+
+/**
+ * Public Functions
+ **/
+int status_open_fd(int fd);
+int status_open_socket(const char * path);
+void status_event(const char * event, job * item, const char * old_state, const char * new_state,
+                  const char * status, int info);
+void status_flush(void);
+const char * status_format(const char * event, job * item, const char * old_state, const char * new_state,
+                           const char * status, int info, size_t * length);
+
+#endif
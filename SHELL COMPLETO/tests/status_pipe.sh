@@ -0,0 +1,23 @@
+#!/bin/sh
+# The shell must survive the reader of its --status-fd pipe going away:
+# the reader takes one byte and exits, later status lines get EPIPE.
+#
+#   tests/status_pipe.sh [./shell]
+
+shell=${1:-./shell}
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+
+mkfifo "$dir/status"
+head -c 1 "$dir/status" > /dev/null &
+printf '/bin/true\nsleep 0.2\n/bin/true\necho still alive\n' |
+	"$shell" --status-fd 3 3> "$dir/status" > "$dir/out" 2>&1
+code=$?
+wait
+
+if [ $code -ne 0 ] || ! grep -q '^still alive$' "$dir/out"; then
+	echo "status_pipe: FAIL (exit $code)"
+	cat "$dir/out"
+	exit 1
+fi
+echo "status_pipe: ok"
@@ -0,0 +1,115 @@
+/**
+ * Linux Job Control Shell Project
+ * trace module
+ *
+ * Each writer claims an index with __atomic_fetch_add and publishes the
+ * record by storing its seq last (release). The dump only takes records
+ * whose seq matches the index it expects, so a record that was being
+ * overwritten or written by an interrupted writer is skipped, not torn.
+ **/
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "trace.h"
+
+int trace_enabled = 1;
+
+static trace_record ring[TRACE_EVENTS];
+static uint64_t next_index; /* Index of the next event to write */
+static uint64_t first_index; /* Events before this one were cleared */
+
+static const char * trace_names[] = {
+	"parse", "parse", "spawn", "exec failed", "terminal", "wait", "state"
+};
+
+/* Same order as enum job_state (job_control.h); any other value is a job that has ended */
+static const char * state_names[] = { "Foreground", "Background", "Stopped", "Waiting" };
+
+/**
+ * Records an event. Async-signal-safe
+ **/
+void trace_event(enum trace_kind kind, pid_t pid, int arg)
+{
+	if (!__atomic_load_n(&trace_enabled, __ATOMIC_RELAXED)) return;
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	uint64_t i = __atomic_fetch_add(&next_index, 1, __ATOMIC_RELAXED);
+	trace_record * r = &ring[i & (TRACE_EVENTS - 1)];
+	__atomic_store_n(&r->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	r->ns = t.tv_sec * 1000000000ULL + t.tv_nsec;
+	r->kind = kind;
+	r->pid = pid;
+	r->arg = arg;
+	__atomic_store_n(&r->seq, i + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Forgets the events recorded so far
+ **/
+void trace_clear(void)
+{
+	__atomic_store_n(&first_index, __atomic_load_n(&next_index, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+}
+
+static int write_all(int fd, const char * buf, size_t n)
+{
+	while (n > 0)
+	{
+		ssize_t w = write(fd, buf, n);
+		if (w < 0)
+		{
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		buf += w;
+		n -= w;
+	}
+	return 0;
+}
+
+/**
+ * Writes the events still in the ring to fd as Chrome trace JSON, oldest
+ * first. Parse begin/end become a duration, the rest are instant events.
+ * Returns -1 on write error
+ **/
+int trace_dump(int fd)
+{
+	char line[256];
+	uint64_t end = __atomic_load_n(&next_index, __ATOMIC_ACQUIRE);
+	uint64_t begin = __atomic_load_n(&first_index, __ATOMIC_ACQUIRE);
+	if (end - begin > TRACE_EVENTS) begin = end - TRACE_EVENTS;
+	int shell_pid = getpid(), first = 1;
+
+	if (write_all(fd, "{\"traceEvents\":[\n", 17) == -1) return -1;
+	for (uint64_t i = begin; i < end; i++)
+	{
+		trace_record r = ring[i & (TRACE_EVENTS - 1)];
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&ring[i & (TRACE_EVENTS - 1)].seq, __ATOMIC_ACQUIRE) != i + 1 || r.seq != i + 1)
+			continue; /* Overwritten or not finished */
+
+		const char * phase = r.kind == TRACE_PARSE_BEGIN ? "B" : r.kind == TRACE_PARSE_END ? "E" : "i";
+		int n = snprintf(line, sizeof(line), "%s{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%llu.%03llu,\"pid\":%d,\"tid\":%d",
+			first ? "" : ",\n", trace_names[r.kind], phase,
+			(unsigned long long) (r.ns / 1000), (unsigned long long) (r.ns % 1000), shell_pid, shell_pid);
+		if (r.kind == TRACE_STATE)
+			n += snprintf(line + n, sizeof(line) - n, ",\"s\":\"p\",\"args\":{\"pgid\":%d,\"state\":\"%s\"}}",
+				r.pid, r.arg >= 0 && r.arg < (int) (sizeof(state_names) / sizeof(state_names[0])) ? state_names[r.arg] : "Done");
+		else if (r.kind == TRACE_EXEC_FAIL)
+			n += snprintf(line + n, sizeof(line) - n, ",\"s\":\"p\",\"args\":{\"pid\":%d,\"error\":\"%s\"}}",
+				r.pid, strerror(r.arg));
+		else if (r.kind == TRACE_PARSE_BEGIN || r.kind == TRACE_PARSE_END)
+			n += snprintf(line + n, sizeof(line) - n, ",\"args\":{\"%s\":%d}}",
+				r.kind == TRACE_PARSE_BEGIN ? "bytes" : "words", r.arg);
+		else
+			n += snprintf(line + n, sizeof(line) - n, ",\"s\":\"p\",\"args\":{\"pid\":%d,\"%s\":%d}}",
+				r.pid, r.kind == TRACE_SPAWN ? "stage" : r.kind == TRACE_WAIT ? "status" : "arg", r.arg);
+		if (write_all(fd, line, n) == -1) return -1;
+		first = 0;
+	}
+	return write_all(fd, "\n]}\n", 4);
+}
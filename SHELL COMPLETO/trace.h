@@ -0,0 +1,47 @@
+/**
+ * Linux Job Control Shell Project
+ * Function prototypes and types for trace module
+ *
+ * Fixed-size ring of lifecycle events with nanosecond timestamps. Writers
+ * only do an atomic fetch-and-add and plain stores, so trace_event() can be
+ * called from a signal handler. When the ring is full the oldest events
+ * are overwritten. Exported in Chrome trace JSON (chrome://tracing,
+ * Perfetto) by the trace builtin.
+ **/
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define TRACE_EVENTS 4096 /* Ring size, must be a power of two */
+
+enum trace_kind {
+	TRACE_PARSE_BEGIN, /* arg: line length */
+	TRACE_PARSE_END,   /* arg: number of words, -1 on syntax error */
+	TRACE_SPAWN,       /* pid: new child, arg: pipeline stage */
+	TRACE_EXEC_FAIL,   /* pid: child, arg: errno */
+	TRACE_TERMINAL,    /* pid: process group given the terminal */
+	TRACE_WAIT,        /* pid: reaped process, arg: wait status */
+	TRACE_STATE        /* pid: job pgid, arg: new enum job_state, or -1 when the job ends */
+};
+
+typedef struct
+{
+	uint64_t seq;  /* Index of the event + 1 once fully written, 0 while being written */
+	uint64_t ns;   /* CLOCK_MONOTONIC */
+	int32_t kind;
+	int32_t pid;
+	int32_t arg;
+} trace_record;
+
+extern int trace_enabled;
+
+/**
+ * Public Functions
+ **/
+void trace_event(enum trace_kind kind, pid_t pid, int arg);
+void trace_clear(void);
+int trace_dump(int fd);
+
+#endif
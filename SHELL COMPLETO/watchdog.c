@@ -0,0 +1,156 @@
+/**
+ * Linux Job Control Shell Project
+ * watchdog module
+ *
+ * The timerfd is only reprogrammed when the earliest deadline changes.
+ * It uses absolute times, so a late wakeup never pushes later deadlines
+ * back.
+ **/
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include "event_loop.h"
+#include "watchdog.h"
+
+static job ** heap;           /* heap[0] has the earliest deadline */
+static int heap_len, heap_cap;
+static int timer_fd = -1;
+static uint64_t armed;        /* Deadline the timerfd is set for, 0 if disarmed */
+static watchdog_fn expire_fn;
+
+static void place(int i, job * item)
+{
+	heap[i] = item;
+	item->deadline_slot = i;
+}
+
+static void sift_up(int i)
+{
+	job * item = heap[i];
+	while (i > 0)
+	{
+		int parent = (i - 1) / 2;
+		if (heap[parent]->deadline <= item->deadline) break;
+		place(i, heap[parent]);
+		i = parent;
+	}
+	place(i, item);
+}
+
+static void sift_down(int i)
+{
+	job * item = heap[i];
+	while (1)
+	{
+		int child = 2 * i + 1;
+		if (child >= heap_len) break;
+		if (child + 1 < heap_len && heap[child + 1]->deadline < heap[child]->deadline) child++;
+		if (item->deadline <= heap[child]->deadline) break;
+		place(i, heap[child]);
+		i = child;
+	}
+	place(i, item);
+}
+
+static void remove_at(int i)
+{
+	job * item = heap[i];
+	job * last = heap[--heap_len];
+	item->deadline_slot = -1;
+	if (i < heap_len)
+	{
+		place(i, last);
+		sift_up(i);
+		sift_down(last->deadline_slot);
+	}
+}
+
+/* Arms the timerfd for the earliest deadline, or disarms it */
+static void rearm(void)
+{
+	uint64_t next = heap_len ? heap[0]->deadline : 0;
+	if (next == armed) return;
+	struct itimerspec its = { { 0, 0 }, { next / 1000000000ULL, next % 1000000000ULL } };
+	if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL) == 0) armed = next;
+}
+
+static void on_timer(int fd, uint32_t events, void * data)
+{
+	uint64_t expirations;
+	struct timespec t;
+	while (read(fd, &expirations, sizeof(expirations)) == -1 && errno == EINTR);
+	armed = 0;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	uint64_t now = t.tv_sec * 1000000000ULL + t.tv_nsec;
+
+	/* The callback may set a new deadline for the same job (grace period) */
+	while (heap_len && heap[0]->deadline <= now)
+	{
+		job * item = heap[0];
+		remove_at(0);
+		item->deadline = 0;
+		expire_fn(item);
+	}
+	rearm();
+}
+
+/**
+ * Creates the timerfd and registers it in the event loop.
+ * Returns -1 on error
+ **/
+int watchdog_init(watchdog_fn on_expire)
+{
+	timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (timer_fd == -1) return -1;
+	if (ev_add(timer_fd, EPOLLIN, on_timer, NULL) == -1)
+	{
+		close(timer_fd);
+		timer_fd = -1;
+		return -1;
+	}
+	expire_fn = on_expire;
+	return 0;
+}
+
+/**
+ * Sets (or moves) the deadline of a job. Returns -1 if the watchdog is not
+ * running or memory allocation fails
+ **/
+int watchdog_set(job * item, uint64_t deadline)
+{
+	if (timer_fd == -1) return -1;
+	if (item->deadline_slot >= 0) remove_at(item->deadline_slot);
+	if (heap_len == heap_cap)
+	{
+		int cap = heap_cap ? 2 * heap_cap : 64;
+		job ** aux = realloc(heap, cap * sizeof(job *));
+		if (aux == NULL) return -1;
+		heap = aux;
+		heap_cap = cap;
+	}
+	item->deadline = deadline ? deadline : 1;
+	place(heap_len++, item);
+	sift_up(heap_len - 1);
+	rearm();
+	return 0;
+}
+
+/**
+ * Removes the deadline of a job, if it has one
+ **/
+void watchdog_cancel(job * item)
+{
+	if (item->deadline_slot < 0) return;
+	remove_at(item->deadline_slot);
+	item->deadline = 0;
+	rearm();
+}
+
+/**
+ * Number of jobs with a deadline
+ **/
+int watchdog_pending(void)
+{
+	return heap_len;
+}
@@ -0,0 +1,29 @@
+/**
+ * Linux Job Control Shell Project
+ * Function prototypes for watchdog module
+ *
+ * Job deadlines (timeout builtin). All of them live in one binary min-heap
+ * ordered by expiry time, and a single timerfd in the event loop is armed
+ * for the earliest one: thousands of deadlines cost one descriptor and
+ * O(log n) per insertion or removal. Each job keeps its heap position, so
+ * a job that ends before its deadline is taken out without a search.
+ * Times are CLOCK_MONOTONIC nanoseconds (stats_now()).
+ **/
+#ifndef _WATCHDOG_H
+#define _WATCHDOG_H
+
+#include <stdint.h>
+#include "job_control.h"
+
+/* Called from the event loop for each job whose deadline has passed; the job is already out of the heap */
+typedef void (*watchdog_fn)(job * item);
+
+/**
+ * Public Functions
+ **/
+int watchdog_init(watchdog_fn on_expire);
+int watchdog_set(job * item, uint64_t deadline);
+void watchdog_cancel(job * item);
+int watchdog_pending(void);
+
+#endif
@@ -0,0 +1,434 @@
+/**
+ * Linux Job Control Shell Project
+ * zygote module
+ *
+ * The helper is forked from the shell, which may have threads (event
+ * log), so the helper and the pool children only make system calls: no
+ * stdio, no malloc. Each ready child owns one end of a close-on-exec
+ * SOCK_SEQPACKET pair, and the shell gets the other end and the child's
+ * pid from the helper. A request is one message. On success exec closes
+ * the child's end and the shell reads EOF, as with the error pipe of the
+ * fork path. On failure the child sends {errno, step} and exits.
+ **/
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include "zygote.h"
+#include "job_control.h"
+
+typedef struct
+{
+	pid_t pgid;          /* 0: new group led by the child */
+	int foreground;
+	int has_mask;
+	sigset_t sigmask;
+	int has_place;
+	launch_place place;
+	int has_limits;
+	launch_limits limits;
+	int has_in;          /* Descriptors follow cwd in the SCM_RIGHTS array */
+	int has_out;
+	int has_err;
+	int has_file;        /* data starts with the program path */
+	int argc;
+	char data[];         /* [file\0] argv[0]\0 argv[1]\0 ... */
+} zygote_request;
+
+typedef struct
+{
+	int err;
+	int step; /* 0: redirection, 1: exec, 2: placement, 3: limits */
+} zygote_error;
+
+/* What the helper sends for every child it creates, with the socket end attached */
+typedef struct
+{
+	pid_t pid;
+} zygote_child;
+
+zygote_counters zygote_stats = { .pool = ZYGOTE_POOL };
+
+static int helper_sock = -1;   /* Shell end of the socket to the helper */
+static pid_t helper_pid;
+static zygote_child ready_pid[ZYGOTE_MAX_POOL];
+static int ready_fd[ZYGOTE_MAX_POOL];
+static int requested;          /* Children asked for and not received yet */
+
+static const char * step_names[] = { "redirection", "exec", "placement", "limits" };
+
+/* Request buffer: used by the shell to build requests and by pool children to receive them */
+static union { zygote_request req; char raw[sizeof(zygote_request) + ZYGOTE_REQUEST]; } message;
+static char * child_argv[ZYGOTE_MAX_ARGS + 1];
+
+/**
+ * Sends buf with up to four descriptors attached
+ **/
+static int send_fds(int sock, const void * buf, size_t len, const int * fds, int nfds)
+{
+	struct iovec iov = { .iov_base = (void *) buf, .iov_len = len };
+	union { struct cmsghdr h; char buf[CMSG_SPACE(4 * sizeof(int))]; } control;
+	struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+	if (nfds > 0)
+	{
+		msg.msg_control = control.buf;
+		msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+		struct cmsghdr * c = CMSG_FIRSTHDR(&msg);
+		c->cmsg_level = SOL_SOCKET;
+		c->cmsg_type = SCM_RIGHTS;
+		c->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+		memcpy(CMSG_DATA(c), fds, nfds * sizeof(int));
+	}
+	ssize_t n;
+	while ((n = sendmsg(sock, &msg, MSG_NOSIGNAL)) == -1 && errno == EINTR);
+	return n == (ssize_t) len ? 0 : -1;
+}
+
+/**
+ * Receives a message and up to four descriptors (close-on-exec).
+ * Returns the message length, 0 on EOF, -1 on error
+ **/
+static ssize_t recv_fds(int sock, void * buf, size_t len, int * fds, int * nfds, int flags)
+{
+	struct iovec iov = { .iov_base = buf, .iov_len = len };
+	union { struct cmsghdr h; char buf[CMSG_SPACE(3 * sizeof(int))]; } control;
+	struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.buf, .msg_controllen = sizeof(control.buf) };
+	ssize_t n;
+	while ((n = recvmsg(sock, &msg, flags | MSG_CMSG_CLOEXEC)) == -1 && errno == EINTR);
+	*nfds = 0;
+	if (n <= 0) return n;
+	for (struct cmsghdr * c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c))
+	{
+		if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+		int count = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		if (count > 4) count = 4;
+		memcpy(fds, CMSG_DATA(c), count * sizeof(int));
+		*nfds = count;
+	}
+	return n;
+}
+
+/**
+ * Pool child: waits for one request and execs it. Never returns
+ **/
+static void ready_child(int sock)
+{
+	int fds[4], nfds;
+	ssize_t n = recv_fds(sock, &message, sizeof(message), fds, &nfds, 0);
+	zygote_request * req = &message.req;
+	if (n < (ssize_t) sizeof(zygote_request) || nfds < 1 + req->has_in + req->has_out + req->has_err)
+		_exit(0); /* The shell closed our socket: pool shrunk or shell gone */
+
+	char * p = req->data, * end = message.raw + n;
+	const char * file = NULL;
+	if (req->has_file)
+	{
+		file = p;
+		p += strlen(p) + 1;
+	}
+	for (int i = 0; i < req->argc && p < end; i++)
+	{
+		child_argv[i] = p;
+		p += strlen(p) + 1;
+	}
+	child_argv[req->argc] = NULL;
+
+	/* Same order as child_exec() in launch.c: placement, limits, setup */
+	zygote_error e = { 0, 2 };
+	if (req->has_place)
+	{
+		struct sched_param param = { 0 };
+		if ((req->place.has_cpus && sched_setaffinity(0, sizeof(cpu_set_t), &req->place.cpus) == -1) ||
+		    (req->place.has_policy && sched_setscheduler(0, req->place.policy, &param) == -1) ||
+		    (req->place.has_nice && setpriority(PRIO_PROCESS, 0, req->place.nice) == -1))
+		{
+			e.err = errno;
+			send(sock, &e, sizeof(e), MSG_NOSIGNAL);
+			_exit(EXIT_FAILURE);
+		}
+	}
+	e.step = 3;
+	if (req->has_limits && apply_limits(0, &req->limits) == -1)
+	{
+		e.err = errno;
+		send(sock, &e, sizeof(e), MSG_NOSIGNAL);
+		_exit(EXIT_FAILURE);
+	}
+	e.step = 0;
+	pid_t pgid = req->pgid ? req->pgid : getpid();
+	setpgid(0, pgid);
+	if (req->foreground) set_terminal(pgid);
+	restore_terminal_signals();
+	if (req->has_mask) sigprocmask(SIG_SETMASK, &req->sigmask, NULL);
+	if (fchdir(fds[0]) == -1 ||
+	    (req->has_in && dup2(fds[1], STDIN_FILENO) == -1) ||
+	    (req->has_out && dup2(fds[1 + req->has_in], STDOUT_FILENO) == -1) ||
+	    (req->has_err && dup2(fds[1 + req->has_in + req->has_out], STDERR_FILENO) == -1))
+	{
+		e.err = errno;
+		send(sock, &e, sizeof(e), MSG_NOSIGNAL);
+		_exit(EXIT_FAILURE);
+	}
+	e.step = 1;
+	if (file) execv(file, child_argv);
+	if (!file || errno == ENOEXEC) execvp(child_argv[0], child_argv); /* Script without #!, as in child_exec() */
+	e.err = errno;
+	send(sock, &e, sizeof(e), MSG_NOSIGNAL);
+	_exit(EXIT_FAILURE);
+}
+
+/**
+ * Helper: creates one pool child and passes its socket end to the shell
+ **/
+static void spawn_ready(int sock)
+{
+	int sv[2];
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1) return;
+	/* CLONE_PARENT: the child's parent is the shell, which will wait for it */
+	pid_t pid = syscall(SYS_clone, CLONE_PARENT | SIGCHLD, NULL, NULL, NULL, NULL);
+	if (pid == 0)
+	{
+		close(sock);
+		close(sv[0]);
+		ready_child(sv[1]);
+	}
+	close(sv[1]);
+	zygote_child child = { pid };
+	send_fds(sock, &child, sizeof(child), pid > 0 ? &sv[0] : NULL, pid > 0 ? 1 : 0);
+	close(sv[0]);
+}
+
+static void helper_main(int sock, int pool, pid_t shell)
+{
+	prctl(PR_SET_PDEATHSIG, SIGKILL);
+	if (getppid() != shell) _exit(0);
+
+	/* Keep only stdio and the socket: pool children must not inherit the shell's descriptors */
+	if (sock != 3)
+	{
+		dup2(sock, 3);
+		sock = 3;
+	}
+	if (syscall(SYS_close_range, 4, ~0U, 0) == -1)
+		for (int fd = 4; fd < 1024; fd++) close(fd);
+
+	for (int i = 0; i < pool; i++) spawn_ready(sock);
+	char c;
+	while (recv(sock, &c, 1, 0) == 1) spawn_ready(sock); /* One byte per child wanted */
+	_exit(0);
+}
+
+/**
+ * Forks the helper, which starts creating pool children. Returns -1 on error
+ **/
+int zygote_start(int pool)
+{
+	int sv[2];
+	if (helper_sock >= 0) return 0;
+	if (pool < 1) pool = 1;
+	if (pool > ZYGOTE_MAX_POOL) pool = ZYGOTE_MAX_POOL;
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1) return -1;
+	pid_t shell = getpid();
+	pid_t pid = fork();
+	if (pid == -1)
+	{
+		close(sv[0]);
+		close(sv[1]);
+		return -1;
+	}
+	if (pid == 0)
+	{
+		close(sv[0]);
+		helper_main(sv[1], pool, shell);
+	}
+	close(sv[1]);
+	helper_sock = sv[0];
+	helper_pid = pid;
+	zygote_stats.pool = pool;
+	requested = pool;
+	return 0;
+}
+
+int zygote_running(void)
+{
+	return helper_sock >= 0;
+}
+
+/* Collects the children the helper has created since the last call */
+static void collect_ready(void)
+{
+	while (requested > 0)
+	{
+		zygote_child child;
+		int fd, nfds;
+		ssize_t n = recv_fds(helper_sock, &child, sizeof(child), &fd, &nfds, MSG_DONTWAIT);
+		if (n <= 0)
+		{
+			if (n == 0 || errno != EAGAIN)
+			{
+				/* Helper gone: the shell keeps working with fork() */
+				close(helper_sock);
+				helper_sock = -1;
+			}
+			return;
+		}
+		requested--;
+		if (nfds != 1) continue; /* The helper could not create it */
+		if (zygote_stats.ready == ZYGOTE_MAX_POOL)
+		{
+			close(fd);
+			continue;
+		}
+		ready_pid[zygote_stats.ready] = child;
+		ready_fd[zygote_stats.ready++] = fd;
+	}
+}
+
+/* Asks the helper for children until ready + requested reaches the pool size */
+static void refill(void)
+{
+	char c = 'r';
+	while (helper_sock >= 0 && zygote_stats.ready + requested < zygote_stats.pool)
+	{
+		if (send(helper_sock, &c, 1, MSG_NOSIGNAL | MSG_DONTWAIT) != 1) break;
+		requested++;
+	}
+}
+
+/**
+ * Changes the pool size. Extra ready children are released (they exit
+ * when their socket closes and are reaped as strays). Returns -1 if the
+ * pool is not running
+ **/
+int zygote_resize(int pool)
+{
+	if (helper_sock < 0) return -1;
+	if (pool < 1) pool = 1;
+	if (pool > ZYGOTE_MAX_POOL) pool = ZYGOTE_MAX_POOL;
+	zygote_stats.pool = pool;
+	collect_ready();
+	while (zygote_stats.ready > pool) close(ready_fd[--zygote_stats.ready]);
+	refill();
+	return 0;
+}
+
+/**
+ * Launches spec on a ready child. Returns its pid, or 0 if the command
+ * must go through fork() (pool empty or request not suitable). Errors of
+ * the child are reported in spec->err/failed like launch_command()
+ **/
+pid_t zygote_launch(launch_spec * spec)
+{
+	if (helper_sock < 0) return 0;
+	collect_ready();
+	if (zygote_stats.ready == 0)
+	{
+		zygote_stats.misses++;
+		refill();
+		return 0;
+	}
+
+	/* Build the request: argv strings must fit in one message */
+	zygote_request * req = &message.req;
+	size_t used = 0;
+	int argc = 0;
+	memset(req, 0, sizeof(*req));
+	if (spec->file)
+	{
+		size_t l = strlen(spec->file) + 1;
+		if (l > ZYGOTE_REQUEST) goto fallback;
+		memcpy(req->data, spec->file, l);
+		used = l;
+		req->has_file = 1;
+	}
+	for (; spec->argv[argc]; argc++)
+	{
+		size_t l = strlen(spec->argv[argc]) + 1;
+		if (argc == ZYGOTE_MAX_ARGS || used + l > ZYGOTE_REQUEST) goto fallback;
+		memcpy(req->data + used, spec->argv[argc], l);
+		used += l;
+	}
+	req->argc = argc;
+	req->pgid = spec->pgid;
+	req->foreground = spec->foreground;
+	if (spec->sigmask)
+	{
+		req->has_mask = 1;
+		req->sigmask = *spec->sigmask;
+	}
+	if (spec->place)
+	{
+		req->has_place = 1;
+		req->place = *spec->place;
+	}
+	req->has_limits = spec->limits != NULL;
+	if (spec->limits) req->limits = *spec->limits;
+
+	/* Descriptors: cwd, then stdin, stdout (pipe ends or redirections opened here) and stderr */
+	int fds[4], nfds = 0, opened[4], nopened = 0; /* cwd and up to three redirections */
+	fds[nfds] = opened[nopened++] = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+	if (fds[nfds++] == -1) goto fallback_close;
+	int in = spec->fd_in > 0 ? spec->fd_in : -1, out = spec->fd_out > 0 ? spec->fd_out : -1;
+	if (spec->file_in && (in = opened[nopened++] = open(spec->file_in, O_RDONLY | O_CLOEXEC)) == -1) goto fallback_close;
+	if (spec->file_out && (out = opened[nopened++] = open(spec->file_out, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666)) == -1)
+		goto fallback_close;
+	if (spec->file_ap && (out = opened[nopened++] = open(spec->file_ap, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666)) == -1)
+		goto fallback_close;
+	if (in >= 0)
+	{
+		req->has_in = 1;
+		fds[nfds++] = in;
+	}
+	if (out >= 0)
+	{
+		req->has_out = 1;
+		fds[nfds++] = out;
+	}
+	if (spec->fd_err > 0)
+	{
+		req->has_err = 1;
+		fds[nfds++] = spec->fd_err;
+	}
+
+	int sock = ready_fd[--zygote_stats.ready];
+	pid_t pid = ready_pid[zygote_stats.ready].pid;
+	int sent = send_fds(sock, req, sizeof(*req) + used, fds, nfds);
+	for (int i = 0; i < nopened; i++) close(opened[i]);
+	if (sent == -1)
+	{
+		/* Child gone: the reaper collects it as a stray */
+		close(sock);
+		zygote_stats.misses++;
+		refill();
+		return 0;
+	}
+
+	spec->err = 0;
+	spec->failed = NULL;
+	zygote_error e;
+	ssize_t n;
+	while ((n = recv(sock, &e, sizeof(e), 0)) == -1 && errno == EINTR);
+	if (n == sizeof(e))
+	{
+		spec->err = e.err;
+		spec->failed = step_names[e.step];
+	}
+	close(sock);
+	zygote_stats.hits++;
+	refill(); /* After the exec: on a busy CPU the helper's clone() does not delay this launch */
+	return pid;
+
+fallback_close:
+	for (int i = 0; i < nopened; i++) if (opened[i] >= 0) close(opened[i]);
+fallback:
+	zygote_stats.fallbacks++;
+	return 0;
+}
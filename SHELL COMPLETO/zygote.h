@@ -0,0 +1,45 @@
+/**
+ * Linux Job Control Shell Project
+ * Function prototypes for zygote module
+ *
+ * "set spawn zygote": a small helper process, forked once, keeps a pool of
+ * children that are already created and wait on a socket. Launching a
+ * command hands one of them its argv, the signal mask, the pgid, the
+ * placement (taskset/nice/sched), the resource limits and its
+ * stdin/stdout/stderr/cwd descriptors (SCM_RIGHTS), and it calls exec at
+ * once.
+ * The fork happens ahead of time, off the launch path. The helper creates
+ * the children with CLONE_PARENT, so they are children of the shell and
+ * the reaper waits for them as usual. When the pool is empty the launch
+ * falls back to fork().
+ **/
+#ifndef _ZYGOTE_H
+#define _ZYGOTE_H
+
+#include "launch.h"
+
+#define ZYGOTE_POOL      4          /* Ready children kept by default */
+#define ZYGOTE_MAX_POOL  64
+#define ZYGOTE_MAX_ARGS  4096
+#define ZYGOTE_REQUEST   (64 * 1024) /* Largest argv (bytes) sent to a ready child */
+
+typedef struct
+{
+	int pool;              /* Ready children wanted */
+	int ready;             /* Ready children held by the shell now */
+	unsigned long hits;    /* Launches served by a ready child */
+	unsigned long misses;  /* Pool empty: launched with fork() */
+	unsigned long fallbacks; /* Not suitable (redirection error, argv too big): fork() */
+} zygote_counters;
+
+extern zygote_counters zygote_stats;
+
+/**
+ * Public Functions
+ **/
+int zygote_start(int pool);
+int zygote_running(void);
+int zygote_resize(int pool);
+pid_t zygote_launch(launch_spec * spec);
+
+#endif